@@ -16,22 +16,28 @@ package main
 
 import (
 	"context"
+	"errors"
 	"fmt"
 	"net/http"
 	_ "net/http/pprof"
 	"os"
 	"os/signal"
+	"sort"
+	"sync"
 	"syscall"
 	"time"
 
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cntopo"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/dsmlu"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/mlu"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/nodeLabel"
 	topo "github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/topology"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/uevent"
 	"github.com/fsnotify/fsnotify"
 	log "github.com/sirupsen/logrus"
+	"k8s.io/apimachinery/pkg/util/wait"
 	pluginapi "k8s.io/kubelet/pkg/apis/deviceplugin/v1beta1"
 )
 
@@ -82,7 +88,15 @@ func main() {
 
 	if options.Mode == mlu.TopologyAware {
 		log.Println("Loading CNTOPO")
-		if err := cntopo.Init(); err != nil {
+		var uuids []string
+		for i := uint(0); i < n; i++ {
+			uuid, err := cndev.GetDeviceUUID(i)
+			if err != nil {
+				log.Panicf("Failed to get device uuid %v", err)
+			}
+			uuids = append(uuids, uuid)
+		}
+		if err := cntopo.InitWithMachineInfoCache(options.CntopoCachePath, uuids); err != nil {
 			log.Errorf("Failed to initialize CNTOPO, err: %v", err)
 			select {}
 		}
@@ -91,14 +105,16 @@ func main() {
 		go topology.SetTopology()
 	}
 
+	var ds *dsmlu.Dsmlu
 	if options.Mode == mlu.DynamicSmlu {
-		dsmlu := dsmlu.NewDsmlu(options)
-		go dsmlu.SyncDsmlu()
+		ds = dsmlu.NewDsmlu(options)
+		go ds.SyncDsmlu()
 	}
 
+	var nl *nodeLabel.NodeLabel
 	if options.NodeLabel {
 		log.Println("Starting NodeLabel")
-		nl := nodeLabel.NewNodeLabel(options)
+		nl = nodeLabel.NewNodeLabel(options)
 		ctx, cancel := context.WithCancel(context.Background())
 		defer cancel()
 		go nl.Run(ctx)
@@ -111,12 +127,21 @@ func main() {
 	}
 	defer watcher.Close()
 
+	rediscover := make(chan struct{}, 1)
+	if options.Uevent {
+		log.Println("Starting uevent listener.")
+		if err := startUeventListener(rediscover); err != nil {
+			log.Errorf("Failed to start uevent listener, rely on polling. err: %v", err)
+		}
+	}
+
 	log.Println("Starting OS watcher.")
 	sigs := startOSWatcher(syscall.SIGHUP, syscall.SIGINT, syscall.SIGTERM, syscall.SIGQUIT)
 
 	go func() {
 		http.HandleFunc("/healthz", func(w http.ResponseWriter, _ *http.Request) {
-			if err := cndev.Init(true); err != nil {
+			if err := mlu.CheckLiveness(); err != nil {
+				log.Warnf("Liveness check failed: %v", err)
 				w.WriteHeader(http.StatusInternalServerError)
 			} else {
 				w.WriteHeader(http.StatusOK)
@@ -135,6 +160,8 @@ func main() {
 			log.Printf("Log level set to %s", level)
 		})
 
+		http.Handle("/metrics", metrics.Handler())
+
 		server := &http.Server{
 			Addr: "0.0.0.0:30107",
 		}
@@ -143,7 +170,7 @@ func main() {
 		log.Panic(server.ListenAndServe())
 	}()
 
-	var restarting bool
+	var restarting, devicesChanged bool
 	var restartTimeout <-chan time.Time
 	var plugins []*mlu.CambriconDevicePlugin
 restart:
@@ -156,6 +183,21 @@ restart:
 		}
 	}
 
+	// The driver is only initialized again once no plugin uses it, other
+	// cndev users wait for it in cndev.
+	if devicesChanged {
+		log.Println("MLU devices changed, discovering devices again.")
+		cndev.PCIe().Invalidate()
+		cndev.EnsureMLUAllOk()
+		if nl != nil {
+			nl.InvalidateHardwareLabels()
+		}
+		if ds != nil {
+			ds.InvalidateSmluModes()
+		}
+		devicesChanged = false
+	}
+
 	log.Println("Starting Plugins.")
 	ts := time.Now()
 	log.Debugf("Starting Plugins in time %s", ts)
@@ -174,11 +216,28 @@ restart:
 			goto restart
 		case event := <-watcher.Events:
 			if event.Name == pluginapi.KubeletSocket && event.Op&fsnotify.Create == fsnotify.Create {
+				if options.FastReregister && !restartPlugins && len(plugins) > 0 {
+					log.Printf("Inotify: %s created, registering plugins again.", pluginapi.KubeletSocket)
+					if err = reregisterPlugins(plugins); err == nil {
+						continue
+					}
+					log.Printf("Failed to register plugins again with err: %v, restarting.", err)
+					goto restart
+				}
 				log.Printf("Inotify: %s created, restarting.", pluginapi.KubeletSocket)
 				goto restart
 			}
 		case err := <-watcher.Errors:
 			log.Printf("Inotify err: %v", err)
+		case <-rediscover:
+			// one hotplug or driver reload comes with a burst of events
+			time.Sleep(ueventSettleTime)
+			select {
+			case <-rediscover:
+			default:
+			}
+			devicesChanged = true
+			goto restart
 		case s := <-sigs:
 			switch s {
 			case syscall.SIGHUP:
@@ -233,19 +292,126 @@ func stopPlugins(plugins []*mlu.CambriconDevicePlugin) error {
 	return nil
 }
 
+const ueventSettleTime = time.Second
+
+// startUeventListener kicks health checks on every MLU uevent, and signals
+// rediscover when devices are added, removed or rebound.
+func startUeventListener(rediscover chan<- struct{}) error {
+	l, err := uevent.Listen()
+	if err != nil {
+		return err
+	}
+	events := make(chan uevent.Event)
+	go func() {
+		if err := l.Run(context.Background(), events); err != nil {
+			log.Errorf("Uevent listener stopped with err: %v", err)
+		}
+	}()
+	go func() {
+		for e := range events {
+			log.Printf("Received MLU uevent %s %s", e.Action, e.DevPath)
+			mlu.KickHealthChecks()
+			if !e.ChangesDevices() {
+				continue
+			}
+			select {
+			case rediscover <- struct{}{}:
+			default:
+			}
+		}
+	}()
+	return nil
+}
+
+// reregisterBackoff retries registration for about 13s in total, kubelet
+// creates its socket slightly before the registration service is ready.
+var reregisterBackoff = wait.Backoff{
+	Duration: 100 * time.Millisecond,
+	Factor:   2,
+	Jitter:   0.1,
+	Steps:    8,
+}
+
+// reregisterPlugins registers all serving plugins with a restarted kubelet
+// concurrently, each retrying with its own backoff.
+func reregisterPlugins(plugins []*mlu.CambriconDevicePlugin) error {
+	errs := make([]error, len(plugins))
+	var wg sync.WaitGroup
+	for i, p := range plugins {
+		wg.Add(1)
+		go func(i int, p *mlu.CambriconDevicePlugin) {
+			defer wg.Done()
+			errs[i] = p.Reregister(reregisterBackoff)
+		}(i, p)
+	}
+	wg.Wait()
+	return errors.Join(errs...)
+}
+
+// serveBackoff retries a failed profile a few times before main falls back
+// to restarting all plugins.
+var serveBackoff = wait.Backoff{
+	Duration: time.Second,
+	Factor:   2,
+	Jitter:   0.1,
+	Steps:    4,
+}
+
+// startPlugins serves the plugin of every profile concurrently, each profile
+// is retried on its own, so one failing profile neither delays nor aborts
+// the others.
 func startPlugins(options mlu.Options) ([]*mlu.CambriconDevicePlugin, bool) {
 	devsM, devsInfoM := mlu.GetDevices(options)
+	profiles := make([]string, 0, len(devsInfoM))
+	for profile := range devsInfoM {
+		profiles = append(profiles, profile)
+	}
+	sort.Strings(profiles)
+
+	served := make([]*mlu.CambriconDevicePlugin, len(profiles))
+	errs := make([]error, len(profiles))
+	var wg sync.WaitGroup
+	for i, profile := range profiles {
+		wg.Add(1)
+		go func(i int, profile string) {
+			defer wg.Done()
+			served[i], errs[i] = servePlugin(options, profile, devsM[profile], devsInfoM[profile])
+		}(i, profile)
+	}
+	wg.Wait()
+
 	var plugins []*mlu.CambriconDevicePlugin
-	for profile, devsInfo := range devsInfoM {
-		devicePlugin := mlu.NewCambriconDevicePlugin(options, profile, devsM[profile], devsInfo)
-		if err := devicePlugin.Serve(); err != nil {
-			log.Printf("Serve device plugin %s, err: %v, restarting.", profile, err)
-			return plugins, true
+	var restart bool
+	for i, profile := range profiles {
+		if errs[i] != nil {
+			log.Printf("Serve device plugin %s, err: %v, restarting.", profile, errs[i])
+			restart = true
+			continue
 		}
-		plugins = append(plugins, devicePlugin)
+		plugins = append(plugins, served[i])
 	}
-	if len(plugins) == 0 {
+	if len(profiles) == 0 {
 		log.Println("No devices found. Waiting indefinitely.")
 	}
-	return plugins, false
+	return plugins, restart
+}
+
+func servePlugin(options mlu.Options, profile string, devs []*pluginapi.Device, devsInfo map[string]*cndev.Device) (*mlu.CambriconDevicePlugin, error) {
+	var plugin *mlu.CambriconDevicePlugin
+	var lastErr error
+	err := wait.ExponentialBackoff(serveBackoff, func() (bool, error) {
+		// Stop closes the channels of a plugin, every attempt needs a new one.
+		p := mlu.NewCambriconDevicePlugin(options, profile, devs, devsInfo)
+		if lastErr = p.Serve(); lastErr != nil {
+			log.Warnf("Serve device plugin %s err: %v, retrying", profile, lastErr)
+			p.Stop()
+			return false, nil
+		}
+		plugin = p
+		return true, nil
+	})
+	if err != nil {
+		return nil, fmt.Errorf("%v, last err: %v", err, lastErr)
+	}
+	return plugin, nil
 }
@@ -33,7 +33,10 @@ type Allocator interface {
 	Allocate(available []uint, required []uint, size int) ([]uint, error)
 }
 
-func New(policy string, devs map[string]*cndev.Device) Allocator {
+// New returns the allocator of the board model, pcieAffinity makes the
+// default allocator keep devices under a common PCIe switch when it can't
+// use MLULink rings.
+func New(policy string, devs map[string]*cndev.Device, pcieAffinity bool) Allocator {
 	model := Reverse(cndev.GetDeviceModel(uint(0)))
 	if strings.Contains(model, "092U") || strings.Contains(model, "8M-073U") {
 		return NewSpiderAllocator(policy, devs)
@@ -41,7 +44,7 @@ func New(policy string, devs map[string]*cndev.Device) Allocator {
 	if strings.Contains(model, "8X-073U") || strings.Contains(model, "8H-095U") {
 		return NewBoardAllocator(policy, devs)
 	}
-	return NewDefaultAllocator(policy, devs)
+	return NewDefaultAllocator(policy, devs, pcieAffinity)
 }
 
 func contains(set []uint, dev uint) bool {
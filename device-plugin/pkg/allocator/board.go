@@ -22,6 +22,7 @@ import (
 
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cntopo"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
 	log "github.com/sirupsen/logrus"
 )
 
@@ -60,6 +61,7 @@ func (a *boardAllocator) Allocate(available []uint, _ []uint, size int) ([]uint,
 	select {
 	case <-ctx.Done():
 		log.Warnf("get rings timeout for %v", available)
+		metrics.Timeouts.Inc("get_rings")
 		if a.policy != bestEffort {
 			return nil, ctx.Err()
 		}
@@ -21,6 +21,7 @@ import (
 
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cntopo"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
 	log "github.com/sirupsen/logrus"
 )
 
@@ -28,20 +29,41 @@ type defaultAllocator struct {
 	policy string
 	cntopo cntopo.Cntopo
 	devs   map[string]*cndev.Device
+	// pcie is used instead of the available order when no ring is used, nil if disabled.
+	pcie *pcieTree
 }
 
-func NewDefaultAllocator(policy string, devs map[string]*cndev.Device) Allocator {
-	return &defaultAllocator{
+func NewDefaultAllocator(policy string, devs map[string]*cndev.Device, pcieAffinity bool) Allocator {
+	a := &defaultAllocator{
 		policy: policy,
 		cntopo: cntopo.New(),
 		devs:   devs,
 	}
+	if pcieAffinity {
+		t, err := newPCIeTreeForDevs(devs)
+		if err != nil {
+			log.Warnf("Failed to read pcie tree, ignore pcie affinity: %v", err)
+		} else {
+			a.pcie = t
+		}
+	}
+	return a
+}
+
+// withoutRings chooses devices when MLULink rings are not used.
+func (a *defaultAllocator) withoutRings(available []uint, size int) []uint {
+	if a.pcie != nil {
+		if devs := a.pcie.allocate(available, size); devs != nil {
+			return devs
+		}
+	}
+	return available[0:size]
 }
 
 func (a *defaultAllocator) Allocate(available []uint, _ []uint, size int) ([]uint, error) {
 	// only for 8-mlu machine
 	if len(available) > 0 && size == 1 || len(available) == size && size == 8 {
-		return available[0:size], nil
+		return a.withoutRings(available, size), nil
 	}
 
 	ctx, cancel := context.WithTimeout(context.Background(), getRingTimeout)
@@ -51,7 +73,8 @@ func (a *defaultAllocator) Allocate(available []uint, _ []uint, size int) ([]uin
 	errorChan := make(chan error)
 
 	go func() {
-		rings, err := a.cntopo.GetRings(available, size)
+		// only the first of the best rings is used
+		rings, err := a.cntopo.GetRingsWithOptions(available, size, cntopo.QueryOptions{BestOnly: true})
 		if err != nil {
 			errorChan <- err
 			return
@@ -62,10 +85,11 @@ func (a *defaultAllocator) Allocate(available []uint, _ []uint, size int) ([]uin
 	select {
 	case <-ctx.Done():
 		log.Warnf("get rings timeout for %v", available)
+		metrics.Timeouts.Inc("get_rings")
 		if a.policy != bestEffort {
 			return nil, ctx.Err()
 		}
-		return available[0:size], nil
+		return a.withoutRings(available, size), nil
 	case err := <-errorChan:
 		return nil, err
 	case rings := <-resultChan:
@@ -77,7 +101,7 @@ func (a *defaultAllocator) Allocate(available []uint, _ []uint, size int) ([]uin
 			if a.policy != bestEffort {
 				return nil, fmt.Errorf("mode %s found no rings", a.policy)
 			}
-			return available[0:size], nil
+			return a.withoutRings(available, size), nil
 		}
 		return rings[0].Ordinals, nil
 	}
@@ -130,7 +130,7 @@ var _ = Describe("Default Allocator", func() {
 					devs:   devsInfo,
 				}
 				getRingTimeout = 50 * time.Millisecond
-				cntopoMock.EXPECT().GetRings(available, size).Times(1).DoAndReturn(func(_, _ interface{}) ([]cntopo.Ring, error) {
+				cntopoMock.EXPECT().GetRingsWithOptions(available, size, cntopo.QueryOptions{BestOnly: true}).Times(1).DoAndReturn(func(_, _, _ interface{}) ([]cntopo.Ring, error) {
 					if timeout {
 						time.Sleep(200 * time.Millisecond)
 					}
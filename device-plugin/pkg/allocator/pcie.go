@@ -0,0 +1,195 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package allocator
+
+import (
+	"fmt"
+	"path/filepath"
+	"regexp"
+	"sort"
+	"strings"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	log "github.com/sirupsen/logrus"
+)
+
+const pciDevicesPath = "/sys/bus/pci/devices"
+
+var hostBridge = regexp.MustCompile(`^pci[0-9a-f]{4}:[0-9a-f]{2}$`)
+
+// pcieTree is the PCIe hierarchy above the MLUs. The sysfs path of a
+// device lists its upstream bridges, for example
+// /sys/devices/pci0000:00/0000:00:01.0/0000:01:00.0/0000:02:08.0/0000:03:00.0
+// is behind switch 0000:01:00.0 on root port 0000:00:01.0.
+type pcieTree struct {
+	// paths[slot] is the host bridge, the bridges and the device BDF.
+	paths map[uint][]string
+}
+
+// newPCIeTree reads the upstream bridges of every slot under the sysfs PCI
+// devices directory root.
+func newPCIeTree(root string, bdfs map[uint]string) (*pcieTree, error) {
+	t := &pcieTree{paths: map[uint][]string{}}
+	for slot, bdf := range bdfs {
+		path, err := filepath.EvalSymlinks(filepath.Join(root, bdf))
+		if err != nil {
+			return nil, err
+		}
+		parts := strings.Split(filepath.ToSlash(path), "/")
+		start := -1
+		for i, part := range parts {
+			if hostBridge.MatchString(part) {
+				start = i
+				break
+			}
+		}
+		if start == -1 || parts[len(parts)-1] != bdf {
+			return nil, fmt.Errorf("unexpected sysfs path %s of %s", path, bdf)
+		}
+		t.paths[slot] = parts[start:]
+	}
+	return t, nil
+}
+
+// newPCIeTreeForDevs builds the tree of the host from the BDFs reported by cndev.
+func newPCIeTreeForDevs(devs map[string]*cndev.Device) (*pcieTree, error) {
+	bdfs := map[uint]string{}
+	for _, dev := range devs {
+		if _, ok := bdfs[dev.Slot]; ok {
+			continue
+		}
+		bdf, err := cndev.GetDeviceBDF(dev.Slot)
+		if err != nil {
+			return nil, fmt.Errorf("get bdf of slot %d: %v", dev.Slot, err)
+		}
+		bdfs[dev.Slot] = bdf
+	}
+	return newPCIeTree(pciDevicesPath, bdfs)
+}
+
+type pcieNode struct {
+	name  string
+	depth int
+	// total counts all slots under the node, slots are the available ones.
+	total    int
+	slots    []uint
+	children []*pcieNode
+}
+
+func (n *pcieNode) child(name string) *pcieNode {
+	for _, c := range n.children {
+		if c.name == name {
+			return c
+		}
+	}
+	c := &pcieNode{name: name, depth: n.depth + 1}
+	n.children = append(n.children, c)
+	return c
+}
+
+func (n *pcieNode) add(path []string, slot uint, available bool) {
+	n.total++
+	if available {
+		n.slots = append(n.slots, slot)
+	}
+	if len(path) > 0 {
+		n.child(path[0]).add(path[1:], slot, available)
+	}
+}
+
+// allocate returns size of the available slots under the deepest bridge
+// that has enough of them, so P2P traffic stays below one switch when
+// possible. Among bridges of the same depth the one with the fewest
+// available slots is used (best-fit), keeping fuller switches for larger
+// requests. It returns nil if there are fewer available slots than size.
+func (t *pcieTree) allocate(available []uint, size int) []uint {
+	if size <= 0 || size > len(available) {
+		return nil
+	}
+	isAvailable := map[uint]bool{}
+	for _, slot := range available {
+		isAvailable[slot] = true
+	}
+	slots := make([]uint, 0, len(t.paths))
+	for slot := range t.paths {
+		slots = append(slots, slot)
+	}
+	for _, slot := range available {
+		if _, ok := t.paths[slot]; !ok {
+			slots = append(slots, slot)
+		}
+	}
+	sort.Slice(slots, func(i, j int) bool { return slots[i] < slots[j] })
+
+	root := &pcieNode{}
+	for _, slot := range slots {
+		path, ok := t.paths[slot]
+		if !ok {
+			// unknown slots only share the root
+			path = []string{fmt.Sprintf("slot%d", slot)}
+		}
+		root.add(path, slot, isAvailable[slot])
+	}
+
+	// bridges leading to a single device, such as switch downstream
+	// ports, are links rather than branches and are skipped
+	best := root
+	var walk func(n *pcieNode)
+	walk = func(n *pcieNode) {
+		for _, c := range n.children {
+			if c.total < 2 || len(c.slots) < size {
+				continue
+			}
+			if c.depth > best.depth || c.depth == best.depth && len(c.slots) < len(best.slots) {
+				best = c
+			}
+			walk(c)
+		}
+	}
+	walk(root)
+	log.Debugf("Prefer pcie bridge %s with available %v for size %d", best.name, best.slots, size)
+	return best.take(size)
+}
+
+// take returns size slots of n, filling the best-fit child when one is
+// large enough and whole children, largest first, otherwise.
+func (n *pcieNode) take(size int) []uint {
+	if len(n.children) == 0 || size >= len(n.slots) {
+		return n.slots[:size]
+	}
+	var res []uint
+	used := map[*pcieNode]bool{}
+	for size > 0 {
+		var fit, largest *pcieNode
+		for _, c := range n.children {
+			if used[c] {
+				continue
+			}
+			if len(c.slots) >= size && (fit == nil || len(c.slots) < len(fit.slots)) {
+				fit = c
+			}
+			if largest == nil || len(c.slots) > len(largest.slots) {
+				largest = c
+			}
+		}
+		if fit != nil {
+			return append(res, fit.take(size)...)
+		}
+		used[largest] = true
+		res = append(res, largest.slots...)
+		size -= len(largest.slots)
+	}
+	return res
+}
@@ -0,0 +1,138 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package allocator
+
+import (
+	"os"
+	"path/filepath"
+	"sort"
+	"strings"
+
+	. "github.com/onsi/ginkgo"
+	. "github.com/onsi/ginkgo/extensions/table"
+	. "github.com/onsi/gomega"
+)
+
+// fakePCIeDevices are the sysfs paths of 8 MLUs: slots 0-3 behind switch
+// 0000:01:00.0 and slots 4-5 behind switch 0000:11:00.0 of host bridge
+// pci0000:00, slots 6-7 behind switch 0000:81:00.0 of host bridge pci0000:80.
+var fakePCIeDevices = []string{
+	"pci0000:00/0000:00:01.0/0000:01:00.0/0000:02:08.0/0000:03:00.0",
+	"pci0000:00/0000:00:01.0/0000:01:00.0/0000:02:10.0/0000:04:00.0",
+	"pci0000:00/0000:00:01.0/0000:01:00.0/0000:02:14.0/0000:05:00.0",
+	"pci0000:00/0000:00:01.0/0000:01:00.0/0000:02:18.0/0000:06:00.0",
+	"pci0000:00/0000:00:03.0/0000:11:00.0/0000:12:08.0/0000:13:00.0",
+	"pci0000:00/0000:00:03.0/0000:11:00.0/0000:12:10.0/0000:14:00.0",
+	"pci0000:80/0000:80:01.0/0000:81:00.0/0000:82:08.0/0000:83:00.0",
+	"pci0000:80/0000:80:01.0/0000:81:00.0/0000:82:10.0/0000:84:00.0",
+}
+
+// writeFakePCIeTree creates the device directories under root/devices and
+// links them from root/bus/pci/devices like sysfs does.
+func writeFakePCIeTree(root string) (string, map[uint]string) {
+	bus := filepath.Join(root, "bus", "pci", "devices")
+	Expect(os.MkdirAll(bus, 0755)).To(Succeed())
+	bdfs := map[uint]string{}
+	for slot, path := range fakePCIeDevices {
+		dir := filepath.Join(root, "devices", path)
+		Expect(os.MkdirAll(dir, 0755)).To(Succeed())
+		bdf := filepath.Base(path)
+		Expect(os.Symlink(filepath.Join("..", "..", "..", "devices", path), filepath.Join(bus, bdf))).To(Succeed())
+		bdfs[uint(slot)] = bdf
+	}
+	return bus, bdfs
+}
+
+var _ = Describe("PCIe Tree", func() {
+
+	var (
+		root string
+		tree *pcieTree
+	)
+
+	BeforeEach(func() {
+		var err error
+		root, err = os.MkdirTemp("", "pcie")
+		Expect(err).NotTo(HaveOccurred())
+		bus, bdfs := writeFakePCIeTree(root)
+		tree, err = newPCIeTree(bus, bdfs)
+		Expect(err).NotTo(HaveOccurred())
+	})
+
+	AfterEach(func() {
+		Expect(os.RemoveAll(root)).To(Succeed())
+	})
+
+	It("reads the upstream bridges from sysfs", func() {
+		Expect(tree.paths[5]).To(Equal(strings.Split(fakePCIeDevices[5], "/")))
+		_, err := newPCIeTree(filepath.Join(root, "bus", "pci", "devices"), map[uint]string{0: "0000:ff:00.0"})
+		Expect(err).To(HaveOccurred())
+	})
+
+	DescribeTable("Allocation Devices",
+		func(available []uint, size int, expected []uint) {
+			got := tree.allocate(available, size)
+			sort.Slice(got, func(i, j int) bool {
+				return got[i] < got[j]
+			})
+			Expect(got).To(Equal(expected))
+		},
+		Entry("size 1 from the most used switch",
+			[]uint{0, 1, 2, 4, 5, 6},
+			1,
+			[]uint{6},
+		),
+		Entry("size 2 from the best-fit switch",
+			[]uint{0, 1, 2, 3, 4, 5, 6, 7},
+			2,
+			[]uint{4, 5},
+		),
+		Entry("size 2 skips switches without enough devices",
+			[]uint{0, 1, 2, 4, 6, 7},
+			2,
+			[]uint{6, 7},
+		),
+		Entry("size 3 under one switch",
+			[]uint{0, 1, 2, 3, 4, 5, 6, 7},
+			3,
+			[]uint{0, 1, 2},
+		),
+		Entry("size 4 under one host bridge",
+			[]uint{0, 1, 4, 5, 6},
+			4,
+			[]uint{0, 1, 4, 5},
+		),
+		Entry("size 3 spans the fewest switches",
+			[]uint{0, 4, 5, 6, 7},
+			3,
+			[]uint{0, 4, 5},
+		),
+		Entry("size 3 across host bridges",
+			[]uint{0, 4, 6},
+			3,
+			[]uint{0, 4, 6},
+		),
+		Entry("unknown slots share only the root",
+			[]uint{6, 9},
+			2,
+			[]uint{6, 9},
+		),
+		Entry("not enough devices",
+			[]uint{0, 1},
+			3,
+			nil,
+		),
+	)
+})
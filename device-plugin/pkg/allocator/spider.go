@@ -22,6 +22,7 @@ import (
 
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cntopo"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
 	log "github.com/sirupsen/logrus"
 )
 
@@ -58,6 +59,7 @@ func (a *spiderAllocator) Allocate(available []uint, _ []uint, size int) ([]uint
 	select {
 	case <-ctx.Done():
 		log.Warnf("get rings timeout for %v", available)
+		metrics.Timeouts.Inc("get_rings")
 		if a.policy != bestEffort {
 			return nil, ctx.Err()
 		}
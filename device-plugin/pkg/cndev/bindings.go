@@ -19,22 +19,38 @@ package cndev
 import "C"
 
 import (
+	"errors"
 	"fmt"
 	"io"
 	"os"
-	"path/filepath"
-	"strconv"
-	"strings"
+	"sync"
 	"time"
 	"unsafe"
 
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
 	log "github.com/sirupsen/logrus"
 )
 
 var (
 	cndevHandleMap map[uint]C.cndevDevice_t
+	// driverLock is held for reading by every driver call, and for writing
+	// while libcndev is initialized or released and cndevHandleMap replaced,
+	// so devices can be rediscovered while other goroutines use cndev.
+	driverLock sync.RWMutex
+
+	// smluLocks holds a *sync.Mutex per slot, see SmluLock.
+	smluLocks sync.Map
+
+	errDriverNotRunning = errors.New("driver is not running")
 )
 
+// SmluLock returns the lock to hold around smlu create and destroy
+// sequences on slot. Smlus of different slots are managed independently.
+func SmluLock(slot uint) *sync.Mutex {
+	l, _ := smluLocks.LoadOrStore(slot, &sync.Mutex{})
+	return l.(*sync.Mutex)
+}
+
 type Device struct {
 	MotherBoard string
 	Numa        int
@@ -76,6 +92,9 @@ type SmluInfo struct {
 }
 
 func Init(healthCheck bool) error {
+	driverLock.Lock()
+	defer driverLock.Unlock()
+
 	if healthCheck {
 		return (errorString(C.cndevInit(C.int(0))))
 	}
@@ -83,10 +102,17 @@ func Init(healthCheck bool) error {
 }
 
 func Release() error {
+	driverLock.Lock()
+	defer driverLock.Unlock()
+
 	return errorString(dl.cndevRelease())
 }
 
 func CreateSmluProfile(pl *DsmluProfile, memUnit int) (uint, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "CreateSmluProfile")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevCreateSMluProfileInfo"); ret != C.CNDEV_SUCCESS {
 		return 0, errorString(ret)
 	}
@@ -101,6 +127,10 @@ func CreateSmluProfile(pl *DsmluProfile, memUnit int) (uint, error) {
 }
 
 func CreateSmluProfileInstance(profileID, index uint) (int, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "CreateSmluProfileInstance")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevCreateSMluInstanceByProfileId"); ret != C.CNDEV_SUCCESS {
 		return 0, errorString(ret)
 	}
@@ -113,6 +143,10 @@ func CreateSmluProfileInstance(profileID, index uint) (int, error) {
 }
 
 func DestroySmlu(instanceHandle int) error {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "DestroySmlu")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevDestroySMluInstanceByHandle"); ret != C.CNDEV_SUCCESS {
 		return errorString(ret)
 	}
@@ -121,6 +155,10 @@ func DestroySmlu(instanceHandle int) error {
 }
 
 func DestroySmluProfile(profileID, index uint) error {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "DestroySmluProfile")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevDestroySMluProfileInfo"); ret != C.CNDEV_SUCCESS {
 		return errorString(ret)
 	}
@@ -129,6 +167,10 @@ func DestroySmluProfile(profileID, index uint) error {
 }
 
 func DeviceMimModeEnabled(idx uint) (bool, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "DeviceMimModeEnabled")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetMimMode"); ret != C.CNDEV_SUCCESS {
 		return false, errorString(ret)
 	}
@@ -140,6 +182,10 @@ func DeviceMimModeEnabled(idx uint) (bool, error) {
 }
 
 func DeviceSmluModeEnabled(idx uint) (bool, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "DeviceSmluModeEnabled")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetSMLUMode"); ret != C.CNDEV_SUCCESS {
 		return false, errorString(ret)
 	}
@@ -151,6 +197,10 @@ func DeviceSmluModeEnabled(idx uint) (bool, error) {
 }
 
 func GetAllMluInstanceInfo(idx uint) ([]MimInfo, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetAllMluInstanceInfo")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetAllMluInstanceInfo"); ret != C.CNDEV_SUCCESS {
 		return nil, errorString(ret)
 	}
@@ -204,6 +254,10 @@ func GetAllMluInstanceInfo(idx uint) ([]MimInfo, error) {
 }
 
 func GetAllSmluInfo(idx uint) ([]SmluInfo, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetAllSmluInfo")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetAllSMluInstanceInfo"); ret != C.CNDEV_SUCCESS {
 		return nil, errorString(ret)
 	}
@@ -258,6 +312,10 @@ func GetAllSmluInfo(idx uint) ([]SmluInfo, error) {
 }
 
 func GetDeviceCount() (uint, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetDeviceCount")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetDeviceCount"); ret != C.CNDEV_SUCCESS {
 		return 0, errorString(ret)
 	}
@@ -269,6 +327,10 @@ func GetDeviceCount() (uint, error) {
 }
 
 func GetDeviceMemory(idx uint) (uint, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetDeviceMemory")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetMemoryUsageV2"); ret != C.CNDEV_SUCCESS {
 		return 0, errorString(ret)
 	}
@@ -278,7 +340,27 @@ func GetDeviceMemory(idx uint) (uint, error) {
 	return uint(cardMemInfo.physicalMemoryTotal), errorString(r)
 }
 
+// GetDeviceUtilization returns the average core utilization of the device in percent.
+func GetDeviceUtilization(idx uint) (int, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetDeviceUtilization")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
+	if ret := dl.checkExist("cndevGetDeviceUtilizationInfo"); ret != C.CNDEV_SUCCESS {
+		return 0, errorString(ret)
+	}
+
+	var utilInfo C.cndevUtilizationInfo_t
+	utilInfo.version = C.CNDEV_VERSION_6
+	r := C.cndevGetDeviceUtilizationInfo(&utilInfo, cndevHandleMap[idx])
+	return int(utilInfo.averageCoreUtilization), errorString(r)
+}
+
 func GetDeviceModel(idx uint) string {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetDeviceModel")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetCardNameStringByDevId"); ret != C.CNDEV_SUCCESS {
 		return ""
 	}
@@ -287,6 +369,10 @@ func GetDeviceModel(idx uint) string {
 }
 
 func GetDeviceProfileInfo(index uint) ([]DsmluProfileInfo, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetDeviceProfileInfo")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetSMluProfileIdInfo"); ret != C.CNDEV_SUCCESS {
 		return nil, errorString(ret)
 	}
@@ -320,6 +406,10 @@ func GetDeviceProfileInfo(index uint) ([]DsmluProfileInfo, error) {
 }
 
 func GetDeviceUUID(idx uint) (string, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetDeviceUUID")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetUUID"); ret != C.CNDEV_SUCCESS {
 		return "", errorString(ret)
 	}
@@ -333,7 +423,30 @@ func GetDeviceUUID(idx uint) (string, error) {
 	return C.GoString((*C.char)(unsafe.Pointer(&uuidInfo.uuid))), nil
 }
 
+// GetDeviceBDF returns the PCIe address of the device, such as 0000:1a:00.0.
+func GetDeviceBDF(idx uint) (string, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetDeviceBDF")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
+	if ret := dl.checkExist("cndevGetPCIeInfoV2"); ret != C.CNDEV_SUCCESS {
+		return "", errorString(ret)
+	}
+
+	var pcieInfo C.cndevPCIeInfoV2_t
+	pcieInfo.version = C.CNDEV_VERSION_6
+	r := C.cndevGetPCIeInfoV2(&pcieInfo, cndevHandleMap[idx])
+	if err := errorString(r); err != nil {
+		return "", err
+	}
+	return fmt.Sprintf("%04x:%02x:%02x.%x", uint(pcieInfo.domain), uint(pcieInfo.bus), uint(pcieInfo.device), uint(pcieInfo.function)), nil
+}
+
 func GetDeviceVersion(idx uint) (uint, uint, uint, uint, uint, uint, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetDeviceVersion")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetVersionInfo"); ret != C.CNDEV_SUCCESS {
 		return 0, 0, 0, 0, 0, 0, errorString(ret)
 	}
@@ -363,55 +476,22 @@ func GetExistProfile(pl *DsmluProfile, memUnit int) (*DsmluProfileInfo, bool) {
 	return nil, false
 }
 
+// GetMLULinkGroups returns the slots connected to each other through MLULinks.
 func GetMLULinkGroups() ([][]uint, error) {
-	num, err := GetDeviceCount()
+	m, err := GetMLULinkMatrix()
 	if err != nil {
 		return nil, err
 	}
-	slots := map[string]uint{}
-	for i := uint(0); i < num; i++ {
-		uuid, _, _, _, err := getDeviceInfo(i)
-		if err != nil {
-			return nil, err
-		}
-		slots[uuid] = i
-	}
-	visited := make([]bool, num)
-	var groups [][]uint
-	var dfs func(slot uint, currentGroup *[]uint) bool
-	dfs = func(slot uint, currentGroup *[]uint) bool {
-		visited[slot] = true
-		*currentGroup = append(*currentGroup, slot)
-		devs, err := getDeviceMLULinkDevs(slot)
-		if err != nil {
-			log.Debugf("failed to get device %d mlulink devs %v", slot, err)
-			return false
-		}
-		for dev := range devs {
-			if nextSlot, ok := slots[dev]; ok && !visited[nextSlot] {
-				if !dfs(nextSlot, currentGroup) {
-					return false
-				}
-			}
-		}
-		return true
-	}
-	for slot := uint(0); slot < num; slot++ {
-		if !visited[slot] {
-			currentGroup := []uint{}
-			if !dfs(slot, &currentGroup) {
-				return nil, fmt.Errorf("failed to get mlulink groups for slot %d", slot)
-			}
-			if len(currentGroup) > 0 {
-				groups = append(groups, currentGroup)
-			}
-		}
-	}
+	groups := m.Groups()
 	log.Debugf("getmlulinkgroups groups %+v", groups)
 	return groups, nil
 }
 
 func GetSmluInfo(instanceHandle int) (SmluInfo, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetSmluInfo")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetSMluInstanceInfo"); ret != C.CNDEV_SUCCESS {
 		return SmluInfo{}, errorString(ret)
 	}
@@ -428,6 +508,10 @@ func GetSmluInfo(instanceHandle int) (SmluInfo, error) {
 }
 
 func NewDeviceLite(idx uint) (*Device, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "NewDeviceLite")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	uuid, sn, motherBoard, path, err := getDeviceInfo(idx)
 	if err != nil {
 		return nil, err
@@ -461,6 +545,13 @@ func errorString(ret C.cndevRet_t) error {
 }
 
 func GetDeviceComputeMode(idx uint, delayTime int) (bool, error) {
+	// sleep for some seconds, neither holding off a rediscovery nor
+	// counted in the call duration
+	time.Sleep(time.Duration(delayTime) * time.Second)
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetDeviceComputeMode")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetComputeMode"); ret != C.CNDEV_SUCCESS {
 		return false, errorString(ret)
 	}
@@ -468,8 +559,6 @@ func GetDeviceComputeMode(idx uint, delayTime int) (bool, error) {
 	var ret C.cndevRet_t
 	var cardComputeMode C.cndevComputeMode_t
 	cardComputeMode.version = C.CNDEV_VERSION_6
-	// sleep for some seconds
-	time.Sleep(time.Duration(delayTime) * time.Second)
 	ret = C.cndevGetComputeMode(&cardComputeMode, cndevHandleMap[idx])
 	return cardComputeMode.mode == C.CNDEV_COMPUTEMODE_PROHIBITED, errorString(ret)
 }
@@ -514,6 +603,13 @@ func getDeviceInfo(idx uint) (string, string, string, string, error) {
 }
 
 func GetDeviceHealthState(idx uint, delayTime int) (int, bool, bool, error) {
+	// sleep for some seconds, neither holding off a rediscovery nor
+	// counted in the call duration
+	time.Sleep(time.Duration(delayTime) * time.Second)
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetDeviceHealthState")
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetCardHealthState"); ret != C.CNDEV_SUCCESS {
 		return 0, false, false, errorString(ret)
 	}
@@ -522,14 +618,15 @@ func GetDeviceHealthState(idx uint, delayTime int) (int, bool, bool, error) {
 	var cardHealthState C.cndevCardHealthState_t
 	var healthCode int
 	cardHealthState.version = C.CNDEV_VERSION_6
-	// sleep for some seconds
-	time.Sleep(time.Duration(delayTime) * time.Second)
 	ret = C.cndevGetCardHealthState(&cardHealthState, cndevHandleMap[idx])
 	healthCode = int(cardHealthState.health)
 	return healthCode, cardHealthState.deviceState == C.CNDEV_HEALTH_STATE_DEVICE_GOOD, cardHealthState.driverState == C.CNDEV_HEALTH_STATE_DRIVER_RUNNING, errorString(ret)
 }
 
 func getDeviceMLULinkDevs(idx uint) (map[string]int, error) {
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetMLULinkPortNumber", "cndevGetMLULinkStatusV2", "cndevGetMLULinkRemoteInfo"); ret != C.CNDEV_SUCCESS {
 		return nil, errorString(ret)
 	}
@@ -572,96 +669,80 @@ func getDeviceNUMA(idx uint) (int, error) {
 	return int(numaNode.nodeId), errorString(r)
 }
 
+// generateDeviceHandleMap builds the handles of all devices aside and then
+// publishes them at once, callers see either the old or the new handles.
 func generateDeviceHandleMap(count uint) error {
+	handles, err := readDeviceHandles(count)
+	if err != nil {
+		return err
+	}
+
+	driverLock.Lock()
+	cndevHandleMap = handles
+	driverLock.Unlock()
+	InvalidateMLULinkMatrix()
+	return nil
+}
+
+func readDeviceHandles(count uint) (map[uint]C.cndevDevice_t, error) {
+	driverLock.RLock()
+	defer driverLock.RUnlock()
+
 	if ret := dl.checkExist("cndevGetDeviceHandleByIndex"); ret != C.CNDEV_SUCCESS {
-		return errorString(ret)
+		return nil, errorString(ret)
 	}
 
-	cndevHandleMap = map[uint]C.cndevDevice_t{}
+	handles := map[uint]C.cndevDevice_t{}
 	for i := uint(0); i < count; i++ {
 		var handle C.cndevDevice_t
 		r := C.cndevGetDeviceHandleByIndex(C.int(i), &handle)
 		if errorString(r) != nil {
-			return errorString(r)
+			return nil, errorString(r)
 		}
-		cndevHandleMap[i] = handle
+		handles[i] = handle
 	}
-	return nil
+	return handles, nil
 }
 
-func FetchMLUCounts() (uint, error) {
-	targetVendorID := uint16(0xcabc) // cambricon mlu vendor ID is 0xcabc
-	targetClassBase := uint8(0x12)   // cambricon mlu class code base is 0x12
-	pciDevicesPath := "/sys/bus/pci/devices"
-
-	readHexFile := func(path string) (uint64, error) {
-		data, err := os.ReadFile(path)
-		if err != nil {
-			return 0, err
-		}
-		s := strings.TrimSpace(string(data))
-		s = strings.TrimPrefix(s, "0x")
-		val, err := strconv.ParseUint(s, 16, 32)
-		if err != nil {
-			return 0, err
-		}
-		return val, nil
+// FetchMLUBDFs returns the sorted PCIe BDFs of the MLU physical functions found in sysfs.
+func FetchMLUBDFs() ([]string, error) {
+	if err := PCIe().Refresh(); err != nil {
+		log.Errorf("Can't read pci dir: %v", err)
+		return nil, err
 	}
+	var bdfs []string
+	for _, f := range PCIe().Functions(PCIeFunction.IsMLU) {
+		bdfs = append(bdfs, f.BDF)
+	}
+	log.Debugf("Find %d mlu devices", len(bdfs))
+	return bdfs, nil
+}
 
-	entries, err := os.ReadDir(pciDevicesPath)
+func FetchMLUCounts() (uint, error) {
+	bdfs, err := FetchMLUBDFs()
 	if err != nil {
-		log.Errorf("Can't read pci dir: %v", err)
 		return 0, err
 	}
-
-	var count uint
-	for _, entry := range entries {
-		devicePath := filepath.Join(pciDevicesPath, entry.Name())
-		if _, err := os.Stat(filepath.Join(devicePath, "physfn")); err == nil {
-			log.Debugf("Skip SR-IOV VF device: %s", devicePath)
-			continue
-		}
-		vendorID, err := readHexFile(filepath.Join(devicePath, "vendor"))
-		if err != nil {
-			log.Warnf("Can't read vendor file: %v", err)
-			continue
-		}
-		if uint16(vendorID) != targetVendorID {
-			log.Debugf("VendorID not match 0x%x", vendorID)
-			continue
-		}
-		classCode, err := readHexFile(filepath.Join(devicePath, "class"))
-		if err != nil {
-			log.Warnf("Can't read class file: %v", err)
-			continue
-		}
-		classBase := uint8((classCode >> 16) & 0xFF)
-		if classBase == targetClassBase {
-			log.Debugf("Find mlu device: %s with vendorID 0x%x,classCode: 0x%x, classBase: 0x%x", devicePath, vendorID, classCode, classBase)
-			count++
-		}
-	}
-
-	log.Debugf("Find %d mlu devices", count)
-	return count, nil
+	return uint(len(bdfs)), nil
 }
 
 func isDriverRunning(counts uint) bool {
-	for i := range counts {
+	err := ForEachSlot(counts, DiscoveryWorkers, func(i uint) error {
 		_, good, running, err := GetDeviceHealthState(i, 0)
 		if err != nil {
 			log.Warnf("GetDeviceHealth for slot %d with err %v", i, err)
-			return false
+			return err
 		}
 		if !good {
 			log.Warnf("MLU device %d health maybe in problem, ignoring at init", i)
 		}
 		if !running {
 			log.Warnf("MLU device %d driver is not running", i)
-			return false
+			return errDriverNotRunning
 		}
-	}
-	return true
+		return nil
+	})
+	return err == nil
 }
 
 func EnsureMLUAllOk() {
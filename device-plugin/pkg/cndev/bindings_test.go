@@ -19,6 +19,7 @@ import (
 	"log"
 	"os"
 	"sort"
+	"sync"
 	"testing"
 	"time"
 
@@ -52,6 +53,37 @@ func TestGetDeviceCount(t *testing.T) {
 	assert.Equal(t, uint(8), count)
 }
 
+func TestRediscoverWhileInUse(t *testing.T) {
+	stop := make(chan struct{})
+	var wg, started sync.WaitGroup
+	for slot := uint(0); slot < 4; slot++ {
+		wg.Add(1)
+		started.Add(1)
+		go func(slot uint) {
+			defer wg.Done()
+			_, err := GetDeviceUUID(slot)
+			assert.NoError(t, err)
+			started.Done()
+			for {
+				select {
+				case <-stop:
+					return
+				default:
+				}
+				_, err := GetDeviceUUID(slot)
+				assert.NoError(t, err)
+			}
+		}(slot)
+	}
+	started.Wait()
+	for i := 0; i < 20; i++ {
+		assert.NoError(t, Init(true))
+		assert.NoError(t, generateDeviceHandleMap(8))
+	}
+	close(stop)
+	wg.Wait()
+}
+
 func TestGetDeviceModel(t *testing.T) {
 	model := GetDeviceModel(uint(0))
 	assert.Equal(t, "MLU290", model)
@@ -63,6 +95,12 @@ func TestGetDeviceMemory(t *testing.T) {
 	assert.Equal(t, uint(16*1024), memory)
 }
 
+func TestGetDeviceUtilization(t *testing.T) {
+	util, err := GetDeviceUtilization(uint(1))
+	assert.NoError(t, err)
+	assert.Equal(t, 80, util)
+}
+
 func TestGetDeviceInfo(t *testing.T) {
 	uuid, _, mb, path, err := getDeviceInfo(uint(1))
 	assert.NoError(t, err)
@@ -71,6 +109,12 @@ func TestGetDeviceInfo(t *testing.T) {
 	assert.Equal(t, fmt.Sprintf("%x", 1111111), mb)
 }
 
+func TestGetDeviceBDF(t *testing.T) {
+	bdf, err := GetDeviceBDF(uint(2))
+	assert.NoError(t, err)
+	assert.Equal(t, "0000:0c:0d.3", bdf)
+}
+
 func TestGetDeviceHealthState(t *testing.T) {
 	health, _, _, err := GetDeviceHealthState(uint(0), 1)
 	assert.NoError(t, err)
@@ -29,15 +29,19 @@ var dl dlhandles
 
 // Initialize CNDEV, open a dynamic reference to the CNDEV library in the process.
 func (dl *dlhandles) cndevInit() C.cndevRet_t {
-	lib := C.CString("libcndev.so")
-	defer C.free(unsafe.Pointer(lib))
+	// Devices are discovered again after a driver reload, the library is
+	// only opened once.
+	if len(dl.handles) == 0 {
+		lib := C.CString("libcndev.so")
+		defer C.free(unsafe.Pointer(lib))
 
-	handle := C.dlopen(lib, C.RTLD_LAZY|C.RTLD_GLOBAL)
-	if handle == C.NULL {
-		log.Printf("Open libcndev with err:%s", C.GoString(C.dlerror()))
-		return C.CNDEV_ERROR_UNINITIALIZED
+		handle := C.dlopen(lib, C.RTLD_LAZY|C.RTLD_GLOBAL)
+		if handle == C.NULL {
+			log.Printf("Open libcndev with err:%s", C.GoString(C.dlerror()))
+			return C.CNDEV_ERROR_UNINITIALIZED
+		}
+		dl.handles = append(dl.handles, handle)
 	}
-	dl.handles = append(dl.handles, handle)
 	return C.cndevInit(C.int(0))
 }
 
@@ -0,0 +1,162 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package cndev
+
+import (
+	"errors"
+	"fmt"
+	"sync"
+	"time"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
+	log "github.com/sirupsen/logrus"
+)
+
+// MLULinkMatrix is the MLULink adjacency of the local slots, Links[i][j] is
+// the number of active ports of slot i connected to slot j.
+type MLULinkMatrix struct {
+	Links [][]int
+	// Failed lists the slots whose links could not be read, they are
+	// reported as groups of their own.
+	Failed []uint
+}
+
+var (
+	mlulinkMatrixLock sync.Mutex
+	mlulinkMatrix     *MLULinkMatrix
+)
+
+// GetMLULinkMatrix returns the MLULink adjacency of all slots. Links do not
+// change while the driver is loaded, so the matrix is read once and cached
+// until the device handles are regenerated. The result is shared and must
+// not be modified.
+func GetMLULinkMatrix() (MLULinkMatrix, error) {
+	mlulinkMatrixLock.Lock()
+	defer mlulinkMatrixLock.Unlock()
+	if mlulinkMatrix != nil {
+		return *mlulinkMatrix, nil
+	}
+	m, err := readMLULinkMatrix()
+	if err != nil {
+		return MLULinkMatrix{}, err
+	}
+	mlulinkMatrix = &m
+	return m, nil
+}
+
+// InvalidateMLULinkMatrix drops the cached matrix, the next
+// GetMLULinkMatrix reads the links again.
+func InvalidateMLULinkMatrix() {
+	mlulinkMatrixLock.Lock()
+	defer mlulinkMatrixLock.Unlock()
+	mlulinkMatrix = nil
+}
+
+// readMLULinkMatrix queries every slot exactly once. A slot that fails is
+// logged and left unlinked instead of failing the whole matrix.
+func readMLULinkMatrix() (MLULinkMatrix, error) {
+	defer metrics.CndevCallDuration.ObserveSince(time.Now(), "GetMLULinkMatrix")
+
+	num, err := GetDeviceCount()
+	if err != nil {
+		return MLULinkMatrix{}, err
+	}
+	uuids := make([]string, num)
+	remotes := make([]map[string]int, num)
+	errs := make([]error, num)
+	ForEachSlot(num, DiscoveryWorkers, func(slot uint) error {
+		uuid, err := GetDeviceUUID(slot)
+		if err != nil {
+			errs[slot] = fmt.Errorf("get uuid: %v", err)
+			return nil
+		}
+		uuids[slot] = fmt.Sprintf("MLU-%s", uuid)
+		if remotes[slot], err = getDeviceMLULinkDevs(slot); err != nil {
+			errs[slot] = fmt.Errorf("get mlulink devs: %v", err)
+		}
+		return nil
+	})
+
+	slots := make(map[string]uint, num)
+	for slot, uuid := range uuids {
+		if errs[slot] == nil {
+			slots[uuid] = uint(slot)
+		}
+	}
+	m := MLULinkMatrix{Links: make([][]int, num)}
+	for i := range m.Links {
+		m.Links[i] = make([]int, num)
+		if errs[i] != nil {
+			log.Warnf("Failed to read mlulinks of slot %d, treat it as unlinked: %v", i, errs[i])
+			m.Failed = append(m.Failed, uint(i))
+			continue
+		}
+		for uuid, count := range remotes[i] {
+			if j, ok := slots[uuid]; ok {
+				m.Links[i][j] += count
+			}
+		}
+	}
+	if num > 0 && uint(len(m.Failed)) == num {
+		return MLULinkMatrix{}, errors.New("failed to read mlulinks of all slots")
+	}
+	log.Debugf("getmlulinkmatrix links %v, failed slots %v", m.Links, m.Failed)
+	return m, nil
+}
+
+// Groups returns the slots connected to each other through MLULinks, as
+// union-find components of the matrix. Groups are ordered by their lowest
+// slot and the slots of a group are sorted.
+func (m MLULinkMatrix) Groups() [][]uint {
+	parent := make([]int, len(m.Links))
+	for i := range parent {
+		parent[i] = i
+	}
+	var find func(i int) int
+	find = func(i int) int {
+		if parent[i] != i {
+			parent[i] = find(parent[i])
+		}
+		return parent[i]
+	}
+	for i, row := range m.Links {
+		for j, count := range row {
+			if count == 0 {
+				continue
+			}
+			ri, rj := find(i), find(j)
+			// keep the lowest slot as root, so groups come out in slot order
+			if ri < rj {
+				parent[rj] = ri
+			} else if rj < ri {
+				parent[ri] = rj
+			}
+		}
+	}
+
+	var groups [][]uint
+	index := make(map[int]int, len(parent))
+	for i := range parent {
+		root := find(i)
+		g, ok := index[root]
+		if !ok {
+			g = len(groups)
+			index[root] = g
+			groups = append(groups, nil)
+		}
+		groups[g] = append(groups[g], uint(i))
+	}
+	return groups
+}
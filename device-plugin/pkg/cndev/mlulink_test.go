@@ -0,0 +1,192 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package cndev
+
+import (
+	"encoding/json"
+	"fmt"
+	"os"
+	"path/filepath"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestMLULinkMatrixGroups(t *testing.T) {
+	m := MLULinkMatrix{
+		Links: [][]int{
+			{0, 0, 0, 1, 0},
+			{0, 0, 0, 0, 0},
+			{0, 0, 0, 0, 2},
+			{0, 0, 0, 0, 0},
+			{0, 1, 0, 0, 0},
+		},
+		Failed: []uint{1},
+	}
+	// links read from one side only still join the slots
+	assert.Equal(t, [][]uint{{0, 3}, {1, 2, 4}}, m.Groups())
+
+	m.Links[4][1] = 0
+	assert.Equal(t, [][]uint{{0, 3}, {1}, {2, 4}}, m.Groups())
+	assert.Empty(t, MLULinkMatrix{}.Groups())
+}
+
+func TestGetMLULinkMatrix(t *testing.T) {
+	InvalidateMLULinkMatrix()
+	m, err := GetMLULinkMatrix()
+	assert.NoError(t, err)
+	assert.Len(t, m.Links, 8)
+	assert.Empty(t, m.Failed)
+	// the link to MLU-d0001012 leaves the node and is not counted
+	assert.Equal(t, []int{0, 1, 2, 1, 1, 0, 0, 0}, m.Links[0])
+
+	cached, err := GetMLULinkMatrix()
+	assert.NoError(t, err)
+	assert.Equal(t, m, cached)
+}
+
+func mockUUID(slot int) []int {
+	uuid := make([]int, 37)
+	for i, c := range fmt.Sprintf("%08x-1916-0000-0000-000000000000", slot+1) {
+		uuid[i] = int(c)
+	}
+	return uuid
+}
+
+// writeMLULinkMock writes a mock of num MLU290 slots on boards of 8, each
+// slot linked twice to its 3 neighbours of the board cube.
+func writeMLULinkMock(b *testing.B, num int) string {
+	const ports = 6
+	uuids := make([][]int, num)
+	status := make([][]int, num)
+	remotes := make([][][]int, num)
+	types := make([]int, num)
+	boards := make([]int, num)
+	for i := 0; i < num; i++ {
+		uuids[i] = mockUUID(i)
+		types[i] = 20
+		boards[i] = i / 8
+		for p := 0; p < ports; p++ {
+			status[i] = append(status[i], 1)
+			remotes[i] = append(remotes[i], mockUUID(i^(1<<(p%3))))
+		}
+	}
+	data, err := json.Marshal(map[string]interface{}{
+		"num":            num,
+		"uuid":           uuids,
+		"mlulink_port":   ports,
+		"mlulink_status": status,
+		"remote_info":    remotes,
+		"type":           types,
+		"motherboard":    boards,
+	})
+	if err != nil {
+		b.Fatal(err)
+	}
+	path := filepath.Join(b.TempDir(), "mock.json")
+	if err := os.WriteFile(path, data, 0644); err != nil {
+		b.Fatal(err)
+	}
+	return path
+}
+
+// dfsMLULinkGroups is the former GetMLULinkGroups, kept as the baseline of
+// the benchmark: it maps uuids with getDeviceInfo and reads the links of
+// every slot while walking them depth first.
+func dfsMLULinkGroups() ([][]uint, error) {
+	num, err := GetDeviceCount()
+	if err != nil {
+		return nil, err
+	}
+	slots := map[string]uint{}
+	for i := uint(0); i < num; i++ {
+		uuid, _, _, _, err := getDeviceInfo(i)
+		if err != nil {
+			return nil, err
+		}
+		slots[uuid] = i
+	}
+	visited := make([]bool, num)
+	var groups [][]uint
+	var dfs func(slot uint, currentGroup *[]uint) bool
+	dfs = func(slot uint, currentGroup *[]uint) bool {
+		visited[slot] = true
+		*currentGroup = append(*currentGroup, slot)
+		devs, err := getDeviceMLULinkDevs(slot)
+		if err != nil {
+			return false
+		}
+		for dev := range devs {
+			if nextSlot, ok := slots[dev]; ok && !visited[nextSlot] {
+				if !dfs(nextSlot, currentGroup) {
+					return false
+				}
+			}
+		}
+		return true
+	}
+	for slot := uint(0); slot < num; slot++ {
+		if !visited[slot] {
+			currentGroup := []uint{}
+			if !dfs(slot, &currentGroup) {
+				return nil, fmt.Errorf("failed to get mlulink groups for slot %d", slot)
+			}
+			groups = append(groups, currentGroup)
+		}
+	}
+	return groups, nil
+}
+
+func BenchmarkGetMLULinkGroups(b *testing.B) {
+	const num = 64
+	origin := os.Getenv("MOCK_JSON")
+	origCount, err := GetDeviceCount()
+	if err != nil {
+		b.Fatal(err)
+	}
+	os.Setenv("MOCK_JSON", writeMLULinkMock(b, num))
+	if err := generateDeviceHandleMap(num); err != nil {
+		b.Fatal(err)
+	}
+	defer func() {
+		os.Setenv("MOCK_JSON", origin)
+		generateDeviceHandleMap(origCount)
+	}()
+
+	b.Run("dfs", func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			groups, err := dfsMLULinkGroups()
+			if err != nil || len(groups) != num/8 {
+				b.Fatalf("groups %v, err %v", groups, err)
+			}
+		}
+	})
+	b.Run("cold", func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			InvalidateMLULinkMatrix()
+			groups, err := GetMLULinkGroups()
+			if err != nil || len(groups) != num/8 {
+				b.Fatalf("groups %v, err %v", groups, err)
+			}
+		}
+	})
+	b.Run("warm", func(b *testing.B) {
+		for i := 0; i < b.N; i++ {
+			if _, err := GetMLULinkGroups(); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+}
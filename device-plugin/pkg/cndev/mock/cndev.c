@@ -204,6 +204,22 @@ cndevRet_t cndevGetMemoryUsageV2(cndevMemoryInfoV2_t *memInfo,
 	return CNDEV_SUCCESS;
 }
 
+cndevRet_t cndevGetDeviceUtilizationInfo(cndevUtilizationInfo_t *utilInfo,
+					 cndevDevice_t device) {
+	cJSON *config;
+	config = readJsonFile();
+
+	/* devices are idle unless listed in "utilization" */
+	utilInfo->averageCoreUtilization = 0;
+	cJSON *util = cJSON_GetObjectItem(config, "utilization");
+	if (util && device < cJSON_GetArraySize(util)) {
+		utilInfo->averageCoreUtilization =
+		    cJSON_GetArrayItem(util, device)->valueint;
+	}
+	cJSON_Delete(config);
+	return CNDEV_SUCCESS;
+}
+
 cndevRet_t cndevGetMLULinkRemoteInfo(cndevMLULinkRemoteInfo_t *remoteinfo,
 				     cndevDevice_t device, int link) {
 	cJSON *config;
@@ -259,7 +275,16 @@ cndevRet_t cndevGetSMLUMode(cndevSMLUMode_t *mode, cndevDevice_t device) {
 
 cndevRet_t cndevGetNUMANodeIdByDevId(cndevNUMANodeId_t *numaNodeId,
 				     cndevDevice_t device) {
+	cJSON *config;
+	config = readJsonFile();
+
+	/* all devices are on node 0 unless listed in "numa" */
 	numaNodeId->nodeId = 0;
+	cJSON *numa = cJSON_GetObjectItem(config, "numa");
+	if (numa && device < cJSON_GetArraySize(numa)) {
+		numaNodeId->nodeId = cJSON_GetArrayItem(numa, device)->valueint;
+	}
+	cJSON_Delete(config);
 	return CNDEV_SUCCESS;
 }
 
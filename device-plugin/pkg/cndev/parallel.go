@@ -0,0 +1,61 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package cndev
+
+import (
+	"fmt"
+	"sync"
+)
+
+// DiscoveryWorkers bounds the number of slots queried concurrently at startup.
+const DiscoveryWorkers = 8
+
+// ForEachSlot calls fn for every slot in [0, count) using at most workers
+// goroutines. It always waits for every call, and returns the error of the
+// lowest failing slot so the result does not depend on scheduling. Callers
+// keep results deterministic by writing into a slice indexed by slot.
+func ForEachSlot(count uint, workers int, fn func(slot uint) error) error {
+	if workers < 1 {
+		workers = 1
+	}
+	if uint(workers) > count {
+		workers = int(count)
+	}
+
+	errs := make([]error, count)
+	slots := make(chan uint)
+	var wg sync.WaitGroup
+	for w := 0; w < workers; w++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for slot := range slots {
+				errs[slot] = fn(slot)
+			}
+		}()
+	}
+	for i := uint(0); i < count; i++ {
+		slots <- i
+	}
+	close(slots)
+	wg.Wait()
+
+	for i, err := range errs {
+		if err != nil {
+			return fmt.Errorf("slot %d: %w", i, err)
+		}
+	}
+	return nil
+}
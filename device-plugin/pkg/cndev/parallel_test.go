@@ -0,0 +1,58 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package cndev
+
+import (
+	"errors"
+	"sync/atomic"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestForEachSlot(t *testing.T) {
+	var running, peak int32
+	seen := make([]bool, 16)
+	err := ForEachSlot(16, 4, func(slot uint) error {
+		n := atomic.AddInt32(&running, 1)
+		for {
+			p := atomic.LoadInt32(&peak)
+			if n <= p || atomic.CompareAndSwapInt32(&peak, p, n) {
+				break
+			}
+		}
+		seen[slot] = true
+		atomic.AddInt32(&running, -1)
+		return nil
+	})
+	assert.NoError(t, err)
+	assert.LessOrEqual(t, peak, int32(4))
+	for _, s := range seen {
+		assert.True(t, s)
+	}
+
+	var calls int32
+	err = ForEachSlot(8, 3, func(slot uint) error {
+		atomic.AddInt32(&calls, 1)
+		if slot == 5 || slot == 2 {
+			return errors.New("boom")
+		}
+		return nil
+	})
+	assert.EqualError(t, err, "slot 2: boom")
+	assert.Equal(t, int32(8), calls)
+
+	assert.NoError(t, ForEachSlot(0, 4, func(uint) error { return errors.New("never called") }))
+}
@@ -0,0 +1,171 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package cndev
+
+import (
+	"os"
+	"path/filepath"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+
+	log "github.com/sirupsen/logrus"
+)
+
+const (
+	mluVendorID  = uint16(0xcabc) // cambricon mlu vendor ID is 0xcabc
+	mluClassBase = uint8(0x12)    // cambricon mlu class code base is 0x12
+
+	pciDevicesPath = "/sys/bus/pci/devices"
+)
+
+// PCIeFunction is the identity of a PCI function, which does not change
+// while the function stays present.
+type PCIeFunction struct {
+	BDF    string
+	Vendor uint16
+	Class  uint32
+	NUMA   int
+	// VF is true for SR-IOV virtual functions.
+	VF bool
+}
+
+// IsMLU reports whether the function is an MLU physical function.
+func (f PCIeFunction) IsMLU() bool {
+	return !f.VF && f.Vendor == mluVendorID && uint8(f.Class>>16) == mluClassBase
+}
+
+// PCIeInventory indexes the functions under a sysfs PCI devices directory.
+// Refresh only lists the directory and probes functions not seen before, so
+// a steady state refresh costs a single readdir. Directory mtime is not used
+// as sysfs does not maintain it, call Invalidate when a function may have
+// been replaced under the same BDF, such as on driver reload.
+type PCIeInventory struct {
+	sync.Mutex
+	root      string
+	functions map[string]PCIeFunction
+}
+
+// NewPCIeInventory returns an empty inventory of the functions under root.
+func NewPCIeInventory(root string) *PCIeInventory {
+	return &PCIeInventory{root: root, functions: map[string]PCIeFunction{}}
+}
+
+var pcieInventory = NewPCIeInventory(pciDevicesPath)
+
+// PCIe returns the inventory of the host PCI devices.
+func PCIe() *PCIeInventory {
+	return pcieInventory
+}
+
+// Invalidate drops all cached identities, the next Refresh probes every function.
+func (p *PCIeInventory) Invalidate() {
+	p.Lock()
+	defer p.Unlock()
+	p.functions = map[string]PCIeFunction{}
+}
+
+// Refresh lists the directory, probes new functions and forgets removed ones.
+func (p *PCIeInventory) Refresh() error {
+	entries, err := os.ReadDir(p.root)
+	if err != nil {
+		return err
+	}
+
+	p.Lock()
+	defer p.Unlock()
+	present := make(map[string]struct{}, len(entries))
+	for _, entry := range entries {
+		bdf := entry.Name()
+		present[bdf] = struct{}{}
+		if _, ok := p.functions[bdf]; ok {
+			continue
+		}
+		f, err := probePCIeFunction(filepath.Join(p.root, bdf), bdf)
+		if err != nil {
+			// not cached, it is probed again on the next refresh
+			log.Warnf("Can't read pci function %s: %v", bdf, err)
+			continue
+		}
+		p.functions[bdf] = f
+	}
+	for bdf := range p.functions {
+		if _, ok := present[bdf]; !ok {
+			delete(p.functions, bdf)
+		}
+	}
+	return nil
+}
+
+// Functions returns the functions matching filter sorted by BDF, all of
+// them if filter is nil.
+func (p *PCIeInventory) Functions(filter func(PCIeFunction) bool) []PCIeFunction {
+	p.Lock()
+	defer p.Unlock()
+	var out []PCIeFunction
+	for _, f := range p.functions {
+		if filter == nil || filter(f) {
+			out = append(out, f)
+		}
+	}
+	sort.Slice(out, func(i, j int) bool { return out[i].BDF < out[j].BDF })
+	return out
+}
+
+// Function returns the identity of a single function.
+func (p *PCIeInventory) Function(bdf string) (PCIeFunction, bool) {
+	p.Lock()
+	defer p.Unlock()
+	f, ok := p.functions[bdf]
+	return f, ok
+}
+
+func probePCIeFunction(path, bdf string) (PCIeFunction, error) {
+	f := PCIeFunction{BDF: bdf, NUMA: -1}
+	if _, err := os.Lstat(filepath.Join(path, "physfn")); err == nil {
+		f.VF = true
+	}
+	vendor, err := readSysfsHex(filepath.Join(path, "vendor"))
+	if err != nil {
+		return f, err
+	}
+	f.Vendor = uint16(vendor)
+	// Other vendors are indexed by vendor only, the rest is never looked at.
+	if f.Vendor != mluVendorID {
+		return f, nil
+	}
+	class, err := readSysfsHex(filepath.Join(path, "class"))
+	if err != nil {
+		return f, err
+	}
+	f.Class = uint32(class)
+	if data, err := os.ReadFile(filepath.Join(path, "numa_node")); err == nil {
+		if numa, err := strconv.Atoi(strings.TrimSpace(string(data))); err == nil {
+			f.NUMA = numa
+		}
+	}
+	return f, nil
+}
+
+func readSysfsHex(path string) (uint64, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return 0, err
+	}
+	s := strings.TrimSpace(string(data))
+	s = strings.TrimPrefix(s, "0x")
+	return strconv.ParseUint(s, 16, 32)
+}
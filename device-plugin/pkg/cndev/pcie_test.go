@@ -0,0 +1,125 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package cndev
+
+import (
+	"fmt"
+	"os"
+	"path/filepath"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+type fakePCIeFunction struct {
+	vendor string
+	class  string
+	numa   string
+	vf     bool
+}
+
+func writeFakePCIeFunction(t testing.TB, root, bdf string, f fakePCIeFunction) {
+	dir := filepath.Join(root, bdf)
+	if err := os.MkdirAll(dir, 0755); err != nil {
+		t.Fatal(err)
+	}
+	files := map[string]string{"vendor": f.vendor, "class": f.class, "numa_node": f.numa}
+	for name, content := range files {
+		if err := os.WriteFile(filepath.Join(dir, name), []byte(content+"\n"), 0644); err != nil {
+			t.Fatal(err)
+		}
+	}
+	if f.vf {
+		if err := os.Symlink("../0000:00:00.0", filepath.Join(dir, "physfn")); err != nil {
+			t.Fatal(err)
+		}
+	}
+}
+
+// newFakeSysfs creates others non-mlu functions and mlus mlu physical
+// functions, each mlu with one virtual function.
+func newFakeSysfs(t testing.TB, others, mlus int) string {
+	root := t.TempDir()
+	for i := 0; i < others; i++ {
+		writeFakePCIeFunction(t, root, fmt.Sprintf("0000:%02x:%02x.%d", i/64, i%64/8, i%8),
+			fakePCIeFunction{vendor: "0x8086", class: "0x060400", numa: "0"})
+	}
+	for i := 0; i < mlus; i++ {
+		writeFakePCIeFunction(t, root, fmt.Sprintf("0000:%02x:00.0", 0x80+i),
+			fakePCIeFunction{vendor: "0xcabc", class: "0x120000", numa: fmt.Sprint(i / 4)})
+		writeFakePCIeFunction(t, root, fmt.Sprintf("0000:%02x:00.1", 0x80+i),
+			fakePCIeFunction{vendor: "0xcabc", class: "0x120000", numa: fmt.Sprint(i / 4), vf: true})
+	}
+	return root
+}
+
+func TestPCIeInventory(t *testing.T) {
+	root := newFakeSysfs(t, 16, 8)
+	p := NewPCIeInventory(root)
+	assert.NoError(t, p.Refresh())
+
+	mlus := p.Functions(PCIeFunction.IsMLU)
+	assert.Len(t, mlus, 8)
+	assert.Equal(t, PCIeFunction{BDF: "0000:80:00.0", Vendor: 0xcabc, Class: 0x120000, NUMA: 0}, mlus[0])
+	assert.Equal(t, 1, mlus[7].NUMA)
+	assert.Len(t, p.Functions(nil), 32)
+	vf, ok := p.Function("0000:81:00.1")
+	assert.True(t, ok)
+	assert.True(t, vf.VF)
+
+	// removed and added functions are picked up by the next refresh
+	assert.NoError(t, os.RemoveAll(filepath.Join(root, "0000:87:00.0")))
+	writeFakePCIeFunction(t, root, "0000:90:00.0", fakePCIeFunction{vendor: "0xcabc", class: "0x120000", numa: "-1"})
+	assert.NoError(t, p.Refresh())
+	mlus = p.Functions(PCIeFunction.IsMLU)
+	assert.Len(t, mlus, 8)
+	assert.Equal(t, "0000:90:00.0", mlus[7].BDF)
+	assert.Equal(t, -1, mlus[7].NUMA)
+
+	// identity is cached until invalidated
+	writeFakePCIeFunction(t, root, "0000:90:00.0", fakePCIeFunction{vendor: "0x8086", class: "0x120000", numa: "0"})
+	assert.NoError(t, p.Refresh())
+	assert.Len(t, p.Functions(PCIeFunction.IsMLU), 8)
+	p.Invalidate()
+	assert.NoError(t, p.Refresh())
+	assert.Len(t, p.Functions(PCIeFunction.IsMLU), 7)
+}
+
+func BenchmarkPCIeInventory(b *testing.B) {
+	root := newFakeSysfs(b, 512, 16)
+	b.Run("cold", func(b *testing.B) {
+		p := NewPCIeInventory(root)
+		for i := 0; i < b.N; i++ {
+			p.Invalidate()
+			if err := p.Refresh(); err != nil {
+				b.Fatal(err)
+			}
+			p.Functions(PCIeFunction.IsMLU)
+		}
+	})
+	b.Run("warm", func(b *testing.B) {
+		p := NewPCIeInventory(root)
+		if err := p.Refresh(); err != nil {
+			b.Fatal(err)
+		}
+		b.ResetTimer()
+		for i := 0; i < b.N; i++ {
+			if err := p.Refresh(); err != nil {
+				b.Fatal(err)
+			}
+			p.Functions(PCIeFunction.IsMLU)
+		}
+	})
+}
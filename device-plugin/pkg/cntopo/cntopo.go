@@ -22,8 +22,10 @@ import (
 	"errors"
 	"fmt"
 	"sync"
+	"time"
 	"unsafe"
 
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
 	log "github.com/sirupsen/logrus"
 )
 
@@ -36,12 +38,35 @@ type Ring struct {
 	NonConflictRingNum int
 }
 
+// QueryOptions bounds the work of a ring query.
+type QueryOptions struct {
+	// Limit is the maximum number of device sets cntopo searches for, 0
+	// means no practical limit.
+	Limit int
+	// BestOnly only returns the rings with the highest NonConflictRingNum,
+	// the devices of other sets are not read.
+	BestOnly bool
+	// Target stops the query at the first ring with at least Target non
+	// conflict rings, 0 searches all sets. Only used with BestOnly.
+	Target int
+}
+
 type Cntopo interface {
 	GetRings(available []uint, size int) ([]Ring, error)
+	GetRingsWithOptions(available []uint, size int, opts QueryOptions) ([]Ring, error)
 }
 
+const maxTopoNum = 1000000
+
 func Init() error {
-	r := dl.cntopoInit()
+	return InitWithMachineInfoCache("", nil)
+}
+
+// InitWithMachineInfoCache initializes CNTOPO, loading the machine info
+// from the snapshot at path instead of probing the MLULink fabric when it
+// was taken on the devices with uuids. A new snapshot is saved otherwise.
+func InitWithMachineInfoCache(path string, uuids []string) error {
+	r := dl.cntopoInit(path, uuids)
 	if r == C.CNTOPO_CONTEXT_NOT_INIT {
 		return errors.New("could not load CNTOPO library")
 	}
@@ -58,6 +83,17 @@ func New() Cntopo {
 }
 
 func (c *cntopo) GetRings(available []uint, size int) ([]Ring, error) {
+	return c.GetRingsWithOptions(available, size, QueryOptions{})
+}
+
+func (c *cntopo) GetRingsWithOptions(available []uint, size int, opts QueryOptions) ([]Ring, error) {
+	defer metrics.GetRingsDuration.ObserveSince(time.Now())
+
+	limit := maxTopoNum
+	if opts.Limit > 0 {
+		limit = opts.Limit
+	}
+
 	ml := C.CString(machineLabel)
 	defer C.free(unsafe.Pointer(ml))
 
@@ -82,35 +118,49 @@ func (c *cntopo) GetRings(available []uint, size int) ([]Ring, error) {
 	var numDevSet C.size_t
 	var devSets *C.cntopoDevSet_t
 	defer C.free(unsafe.Pointer(devSets))
-	r = C.cntopoFindDevSets(queryHandle, C.RING, 1000000, &devSets, &numDevSet)
+	r = C.cntopoFindDevSets(queryHandle, C.RING, C.size_t(limit), &devSets, &numDevSet)
 	if err := errorString(r); err != nil {
 		return nil, err
 	}
-	devSetsResult := (*[100]C.cntopoDevSet_t)(unsafe.Pointer(devSets))[:int(numDevSet)]
+	devSetsResult := unsafe.Slice(devSets, int(numDevSet))
 
 	var rings []Ring
 	var devSize C.size_t
+	best := -1
 	for i := 0; i < int(numDevSet); i++ {
+		var topos *C.cntopoTopo_t
+		var numTopo C.size_t
+		r = C.cntopoFindTopos(devSetsResult[i], C.RING, &topos, &numTopo)
+		if err := errorString(r); err != nil {
+			return nil, err
+		}
+		if opts.BestOnly {
+			if int(numTopo) < best {
+				continue
+			}
+			if int(numTopo) > best {
+				best = int(numTopo)
+				rings = rings[:0]
+			}
+		}
+
 		r = C.cntopoGetDevSetSize(devSetsResult[i], &devSize)
 		if err := errorString(r); err != nil {
 			return nil, err
 		}
-		var devOrdinals []uint
+		devOrdinals := make([]uint, 0, int(devSize))
 		for index := 0; index < int(devSize); index++ {
 			var devInfo C.cntopoDevInfo_t
 			C.cntopoGetDevInfoFromDevSet(devSetsResult[i], C.size_t(index), &devInfo)
 			devOrdinals = append(devOrdinals, uint(devInfo.dev_ordinal))
 		}
-		var topos *C.cntopoTopo_t
-		var numTopo C.size_t
-		r = C.cntopoFindTopos(devSetsResult[i], C.RING, &topos, &numTopo)
-		if err := errorString(r); err != nil {
-			return nil, err
-		}
 		rings = append(rings, Ring{
 			NonConflictRingNum: int(numTopo),
 			Ordinals:           devOrdinals,
 		})
+		if opts.BestOnly && opts.Target > 0 && best >= opts.Target {
+			break
+		}
 	}
 
 	log.Debugf("get rings %+v", rings)
@@ -32,7 +32,8 @@ var ctx C.cntopoContext_t
 const machineLabel = "localhost"
 
 // Initialize CNTOPO, open a dynamic reference to the CNTOPO library in the process.
-func (dl *dlhandles) cntopoInit() C.cntopoResult_t {
+// The machine info is loaded from machineInfoCache if it was saved on the same devices.
+func (dl *dlhandles) cntopoInit(machineInfoCache string, uuids []string) C.cntopoResult_t {
 	lib := C.CString("libcntopo.so")
 	defer C.free(unsafe.Pointer(lib))
 
@@ -46,10 +47,8 @@ func (dl *dlhandles) cntopoInit() C.cntopoResult_t {
 	if err := errorString(r); err != nil {
 		return r
 	}
-	var nodeInfos C.cntopoMachineInfo_t
-	var sizeBytes int
-	r = C.cntopoGetLocalMachineInfo(ctx, (*C.cntopoMachineInfo_t)(unsafe.Pointer(&nodeInfos)), (*C.size_t)(unsafe.Pointer(&sizeBytes)))
-	if err := errorString(r); err != nil {
+	nodeInfos, r := machineInfo(machineInfoCache, uuids)
+	if r != C.CNTOPO_RET_SUCCESS {
 		return r
 	}
 
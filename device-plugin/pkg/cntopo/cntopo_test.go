@@ -0,0 +1,149 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package cntopo
+
+import (
+	"encoding/json"
+	"fmt"
+	"os"
+	"path/filepath"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+// writeMockJSON writes a libcntopo mock config with the sets of size devices
+// among num, the set i having i%7 non conflict rings.
+func writeMockJSON(t testing.TB, num, size int) {
+	var sets [][]int
+	var combine func(start int, set []int)
+	combine = func(start int, set []int) {
+		if len(set) == size {
+			sets = append(sets, append([]int(nil), set...))
+			return
+		}
+		for i := start; i < num; i++ {
+			combine(i+1, append(set, i))
+		}
+	}
+	combine(0, nil)
+	topoNums := make([]int, len(sets))
+	for i := range topoNums {
+		topoNums[i] = i % 7
+	}
+	data, err := json.Marshal(map[string]interface{}{"dev_sets": sets, "topo_nums": topoNums})
+	if err != nil {
+		t.Fatal(err)
+	}
+	path := filepath.Join(t.TempDir(), "mock.json")
+	if err := os.WriteFile(path, data, 0644); err != nil {
+		t.Fatal(err)
+	}
+	t.Setenv("MOCK_JSON", path)
+}
+
+// initMock loads the libcntopo mock, built by make pkg/cntopo/test/libcntopo.so
+// and found through LD_LIBRARY_PATH.
+func initMock(t testing.TB) {
+	if err := Init(); err != nil {
+		t.Skipf("libcntopo mock not available: %v", err)
+	}
+	t.Cleanup(func() { Release() })
+}
+
+func TestInitWithMachineInfoCache(t *testing.T) {
+	path := filepath.Join(t.TempDir(), "cntopo", "machine-info.json")
+	uuids := []string{"MLU-1", "MLU-0"}
+	initCached := func(uuids []string) string {
+		if err := InitWithMachineInfoCache(path, uuids); err != nil {
+			t.Skipf("libcntopo mock not available: %v", err)
+		}
+		assert.NoError(t, Release())
+		data, err := os.ReadFile(path)
+		assert.NoError(t, err)
+		return string(data)
+	}
+
+	probed := initCached(uuids)
+	assert.Equal(t, probed, initCached([]string{"MLU-0", "MLU-1"}))
+
+	// devices changed, probe again
+	reprobed := initCached([]string{"MLU-0", "MLU-2"})
+	assert.NotEqual(t, probed, reprobed)
+
+	// an interrupted save is not taken as valid
+	assert.NoError(t, os.Remove(uuidsPath(path)))
+	assert.NotEqual(t, reprobed, initCached([]string{"MLU-0", "MLU-2"}))
+}
+
+func TestGetRingsWithOptions(t *testing.T) {
+	initMock(t)
+	writeMockJSON(t, 8, 2)
+	c := New()
+	available := []uint{0, 1, 2, 3, 4, 5, 6, 7}
+
+	rings, err := c.GetRings(available, 2)
+	assert.NoError(t, err)
+	assert.Len(t, rings, 28)
+	assert.Equal(t, Ring{Ordinals: []uint{0, 1}, NonConflictRingNum: 0}, rings[0])
+
+	rings, err = c.GetRingsWithOptions(available, 2, QueryOptions{Limit: 10})
+	assert.NoError(t, err)
+	assert.Len(t, rings, 10)
+
+	rings, err = c.GetRingsWithOptions(available, 2, QueryOptions{BestOnly: true})
+	assert.NoError(t, err)
+	assert.Len(t, rings, 4)
+	for _, r := range rings {
+		assert.Equal(t, 6, r.NonConflictRingNum)
+	}
+
+	rings, err = c.GetRingsWithOptions(available, 2, QueryOptions{BestOnly: true, Target: 4})
+	assert.NoError(t, err)
+	assert.Equal(t, []Ring{{Ordinals: []uint{0, 5}, NonConflictRingNum: 4}}, rings)
+}
+
+// BenchmarkGetRings runs with the libcntopo mock:
+//
+//	make pkg/cntopo/test/libcntopo.so
+//	LD_LIBRARY_PATH=$PWD/pkg/cntopo/test go test -run xxx -bench GetRings ./pkg/cntopo
+func BenchmarkGetRings(b *testing.B) {
+	initMock(b)
+	for _, num := range []int{8, 16, 32} {
+		writeMockJSON(b, num, 4)
+		available := make([]uint, num)
+		for i := range available {
+			available[i] = uint(i)
+		}
+		c := New()
+		for _, bc := range []struct {
+			name string
+			opts QueryOptions
+		}{
+			{"all", QueryOptions{}},
+			{"best", QueryOptions{BestOnly: true}},
+			{"limit", QueryOptions{BestOnly: true, Limit: 256}},
+			{"target", QueryOptions{BestOnly: true, Target: 6}},
+		} {
+			b.Run(fmt.Sprintf("%d/%s", num, bc.name), func(b *testing.B) {
+				for i := 0; i < b.N; i++ {
+					if _, err := c.GetRingsWithOptions(available, 4, bc.opts); err != nil {
+						b.Fatal(err)
+					}
+				}
+			})
+		}
+	}
+}
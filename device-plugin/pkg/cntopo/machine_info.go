@@ -0,0 +1,121 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package cntopo
+
+// #include "include/cntopo.h"
+import "C"
+
+import (
+	"encoding/json"
+	"fmt"
+	"os"
+	"path/filepath"
+	"reflect"
+	"sort"
+	"unsafe"
+
+	log "github.com/sirupsen/logrus"
+)
+
+// The machine info snapshot is saved by cntopo itself, the uuids of the
+// devices it was probed on are kept next to it to validate it.
+func uuidsPath(path string) string {
+	return path + ".uuids"
+}
+
+func sortedUUIDs(uuids []string) []string {
+	sorted := append([]string(nil), uuids...)
+	sort.Strings(sorted)
+	return sorted
+}
+
+// loadMachineInfo loads the snapshot at path if it was taken on the devices
+// with uuids.
+func loadMachineInfo(path string, uuids []string) (C.cntopoMachineInfo_t, error) {
+	data, err := os.ReadFile(uuidsPath(path))
+	if err != nil {
+		return nil, err
+	}
+	var saved []string
+	if err := json.Unmarshal(data, &saved); err != nil {
+		return nil, fmt.Errorf("decode %s: %v", uuidsPath(path), err)
+	}
+	if !reflect.DeepEqual(saved, sortedUUIDs(uuids)) {
+		return nil, fmt.Errorf("snapshot taken on devices %v, not %v", saved, sortedUUIDs(uuids))
+	}
+
+	file := C.CString(path)
+	defer C.free(unsafe.Pointer(file))
+	var info C.cntopoMachineInfo_t
+	if err := errorString(C.cntopoLoadMachineInfoFromFile(ctx, file, &info)); err != nil {
+		return nil, err
+	}
+	return info, nil
+}
+
+// saveMachineInfo saves the snapshot through a temporary file. The uuids
+// are removed first and written last, so that an interrupted save is never
+// taken as valid.
+func saveMachineInfo(path string, uuids []string, info C.cntopoMachineInfo_t) error {
+	if err := os.MkdirAll(filepath.Dir(path), 0755); err != nil {
+		return err
+	}
+	if err := os.Remove(uuidsPath(path)); err != nil && !os.IsNotExist(err) {
+		return err
+	}
+	tmp := path + ".tmp"
+	file := C.CString(tmp)
+	defer C.free(unsafe.Pointer(file))
+	if err := errorString(C.cntopoSaveMachineInfoToFile(info, file)); err != nil {
+		return err
+	}
+	if err := os.Rename(tmp, path); err != nil {
+		return err
+	}
+	data, err := json.Marshal(sortedUUIDs(uuids))
+	if err != nil {
+		return err
+	}
+	return os.WriteFile(uuidsPath(path), data, 0644)
+}
+
+// machineInfo returns the machine info from the snapshot at path when it is
+// valid for uuids, or else probes it and saves it there. An empty path
+// always probes.
+func machineInfo(path string, uuids []string) (C.cntopoMachineInfo_t, C.cntopoResult_t) {
+	if path != "" {
+		info, err := loadMachineInfo(path, uuids)
+		if err == nil {
+			log.Printf("Loaded CNTOPO machine info from %s", path)
+			return info, C.CNTOPO_RET_SUCCESS
+		}
+		if !os.IsNotExist(err) {
+			log.Printf("CNTOPO machine info %s is invalid, probe again: %v", path, err)
+		}
+	}
+
+	var info C.cntopoMachineInfo_t
+	var sizeBytes C.size_t
+	r := C.cntopoGetLocalMachineInfo(ctx, &info, &sizeBytes)
+	if r != C.CNTOPO_RET_SUCCESS {
+		return nil, r
+	}
+	if path != "" {
+		if err := saveMachineInfo(path, uuids, info); err != nil {
+			log.Warnf("Failed to save CNTOPO machine info to %s: %v", path, err)
+		}
+	}
+	return info, C.CNTOPO_RET_SUCCESS
+}
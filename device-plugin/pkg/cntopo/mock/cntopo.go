@@ -54,3 +54,18 @@ func (mr *CntopoMockRecorder) GetRings(available, size any) *gomock.Call {
 	mr.mock.ctrl.T.Helper()
 	return mr.mock.ctrl.RecordCallWithMethodType(mr.mock, "GetRings", reflect.TypeOf((*Cntopo)(nil).GetRings), available, size)
 }
+
+// GetRingsWithOptions mocks base method.
+func (m *Cntopo) GetRingsWithOptions(available []uint, size int, opts cntopo.QueryOptions) ([]cntopo.Ring, error) {
+	m.ctrl.T.Helper()
+	ret := m.ctrl.Call(m, "GetRingsWithOptions", available, size, opts)
+	ret0, _ := ret[0].([]cntopo.Ring)
+	ret1, _ := ret[1].(error)
+	return ret0, ret1
+}
+
+// GetRingsWithOptions indicates an expected call of GetRingsWithOptions.
+func (mr *CntopoMockRecorder) GetRingsWithOptions(available, size, opts any) *gomock.Call {
+	mr.mock.ctrl.T.Helper()
+	return mr.mock.ctrl.RecordCallWithMethodType(mr.mock, "GetRingsWithOptions", reflect.TypeOf((*Cntopo)(nil).GetRingsWithOptions), available, size, opts)
+}
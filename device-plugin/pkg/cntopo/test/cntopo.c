@@ -18,6 +18,7 @@
 #include "cJSON.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 cJSON *readJsonFile() {
 	FILE *f;
@@ -42,9 +43,59 @@ cntopoResult_t cntopoInitContext(cntopoContext_t *ctx) {
 	return CNTOPO_RET_SUCCESS;
 }
 
+cntopoResult_t cntopoDestroyContext(cntopoContext_t ctx) {
+	return CNTOPO_RET_SUCCESS;
+}
+
+const char *cntopoGetErrorStr(cntopoResult_t result) {
+	return "mock error";
+}
+
+/* Every probe returns a different machine info, to tell it from a load. */
 cntopoResult_t cntopoGetLocalMachineInfo(cntopoContext_t ctx,
 					 cntopoMachineInfo_t *node_info,
 					 size_t *size_bytes) {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	char *info = malloc(64);
+	int n = snprintf(info, 64, "{\"probed\":%lld%09ld}", (long long)ts.tv_sec, ts.tv_nsec);
+	*node_info = info;
+	if (size_bytes) {
+		*size_bytes = (size_t)n + 1;
+	}
+	return CNTOPO_RET_SUCCESS;
+}
+
+cntopoResult_t cntopoSaveMachineInfoToFile(cntopoMachineInfo_t node_info,
+					   const char *file_name) {
+	FILE *f = fopen(file_name, "wb");
+	if (!f) {
+		return CNTOPO_FILE_PATHERR;
+	}
+	fputs(node_info, f);
+	fclose(f);
+	return CNTOPO_RET_SUCCESS;
+}
+
+cntopoResult_t cntopoLoadMachineInfoFromFile(cntopoContext_t ctx,
+					     const char *file_name,
+					     cntopoMachineInfo_t *node_info) {
+	FILE *f = fopen(file_name, "rb");
+	long len;
+	if (!f) {
+		return CNTOPO_FILE_PATHERR;
+	}
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (len <= 0) {
+		fclose(f);
+		return CNTOPO_FILE_EMPTY;
+	}
+	*node_info = malloc(len + 1);
+	fread(*node_info, 1, len, f);
+	(*node_info)[len] = '\0';
+	fclose(f);
 	return CNTOPO_RET_SUCCESS;
 }
 
@@ -75,6 +126,11 @@ cntopoResult_t cntopoSetWhitelistDevOrdinal(cntopoQuery_t query_handle,
 	return CNTOPO_RET_SUCCESS;
 }
 
+/*
+ * Each dev set is laid out as {size, num_topo, ordinals...} and the handle
+ * points to the ordinals, so the set can be read without the json file.
+ * num_topo comes from the optional "topo_nums" array, 2 by default.
+ */
 cntopoResult_t cntopoFindDevSets(cntopoQuery_t query_handle,
 				 cntopoTopoType_t topo_type,
 				 size_t max_topo_num, cntopoDevSet_t **dev_sets,
@@ -82,20 +138,28 @@ cntopoResult_t cntopoFindDevSets(cntopoQuery_t query_handle,
 	cJSON *config;
 	config = readJsonFile();
 	cJSON *devsets = cJSON_GetObjectItem(config, "dev_sets");
+	cJSON *topo_nums = cJSON_GetObjectItem(config, "topo_nums");
 	size_t p = (size_t)cJSON_GetArraySize(devsets);
-	cJSON *devs = cJSON_GetArrayItem(devsets, 0);
-	size_t n = (size_t)cJSON_GetArraySize(devs);
-	size_t u;
-	size_t **ds = malloc(p * n * sizeof(size_t *));
-	for (size_t i = 0; i < p; i++) {
-		ds[i] = malloc(n * sizeof(size_t));
+	if (p > max_topo_num) {
+		p = max_topo_num;
 	}
-	for (size_t i = 0; i < p; i++) {
-		for (size_t j = 0; j < n; j++) {
-			cJSON *s = cJSON_GetArrayItem(devsets, (int)i);
-			u = (size_t)cJSON_GetArrayItem(s, (int)j)->valueint;
-			ds[i][j] = u;
+	size_t **ds = malloc(p * sizeof(size_t *));
+	cJSON *s = devsets ? devsets->child : NULL;
+	cJSON *topo_num = topo_nums ? topo_nums->child : NULL;
+	for (size_t i = 0; i < p; i++, s = s->next) {
+		size_t n = (size_t)cJSON_GetArraySize(s);
+		size_t *set = malloc((n + 2) * sizeof(size_t));
+		set[0] = n;
+		set[1] = 2;
+		if (topo_num) {
+			set[1] = (size_t)topo_num->valueint;
+			topo_num = topo_num->next;
+		}
+		cJSON *ordinal = s->child;
+		for (size_t j = 0; j < n; j++, ordinal = ordinal->next) {
+			set[j + 2] = (size_t)ordinal->valueint;
 		}
+		ds[i] = set + 2;
 	}
 	*dev_sets = (cntopoDevSet_t *)ds;
 	cJSON_Delete(config);
@@ -104,21 +168,14 @@ cntopoResult_t cntopoFindDevSets(cntopoQuery_t query_handle,
 }
 
 cntopoResult_t cntopoGetDevSetSize(cntopoDevSet_t dev_set, size_t *size) {
-	cJSON *config;
-	config = readJsonFile();
-	cJSON *devsets = cJSON_GetObjectItem(config, "dev_sets");
-	size_t p = (size_t)cJSON_GetArraySize(devsets);
-	cJSON *devs = cJSON_GetArrayItem(devsets, 0);
-	size_t n = (size_t)cJSON_GetArraySize(devs);
-	cJSON_Delete(config);
-	*size = n;
+	*size = *((size_t *)(dev_set) - 2);
 	return CNTOPO_RET_SUCCESS;
 }
 
 cntopoResult_t cntopoFindTopos(cntopoDevSet_t dev_set,
 			       cntopoTopoType_t topo_type, cntopoTopo_t **topos,
 			       size_t *num_topo) {
-	*num_topo = (size_t)2;
+	*num_topo = *((size_t *)(dev_set) - 1);
 	return CNTOPO_RET_SUCCESS;
 }
 
@@ -34,7 +34,7 @@ void Test_cntopo() {
 		{2,3},
 		{6,7},
 	};
-	size_t *size_bytes;
+	size_t size_bytes;
 
 	bool test_failed = false;
 
@@ -43,7 +43,7 @@ void Test_cntopo() {
 	dev_sets = (cntopoDevSet_t *)malloc(4 * 2 * sizeof(cntopoDevSet_t));
 
 	cntopoInitContext(&ctx);
-	cntopoGetLocalMachineInfo(ctx, &node_info, size_bytes);
+	cntopoGetLocalMachineInfo(ctx, &node_info, &size_bytes);
 	cntopoAddMachineInfo(ctx, node_info, machine_label);
 	cntopoCreateQuery(ctx, &query);
 	cntopoSetDevNumFilter(query, machine_label, 4);
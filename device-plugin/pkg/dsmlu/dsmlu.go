@@ -16,25 +16,40 @@ package dsmlu
 
 import (
 	"context"
-	"strconv"
-	"strings"
+	"errors"
+	"fmt"
 	"sync"
 	"time"
 
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/informer"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/mlu"
 	log "github.com/sirupsen/logrus"
 	v1 "k8s.io/api/core/v1"
 	metav1 "k8s.io/apimachinery/pkg/apis/meta/v1"
-	"k8s.io/apimachinery/pkg/fields"
 	"k8s.io/apimachinery/pkg/util/wait"
 	"k8s.io/client-go/kubernetes"
 	"k8s.io/client-go/tools/cache"
+	"k8s.io/client-go/util/workqueue"
 )
 
+const (
+	busyRetryPeriod  = 5 * time.Second
+	defaultGCWorkers = 4
+	fullResyncPeriod = 10 * time.Minute
+)
+
+var errSlotBusy = errors.New("slot has pod in allocating")
+
 type Dsmlu struct {
-	executeLock sync.Mutex
-	option      mlu.Options
+	option mlu.Options
+
+	desired *desiredState
+	// smluEnabled caches the smlu mode of each slot, which only changes with
+	// driver reload, see InvalidateSmluModes.
+	smluEnabled sync.Map
+	queue       workqueue.RateLimitingInterface
 
 	k8sClient kubernetes.Interface
 }
@@ -43,44 +58,120 @@ func NewDsmlu(o mlu.Options) *Dsmlu {
 	return &Dsmlu{
 		option: o,
 
+		desired: newDesiredState(),
+		queue:   workqueue.NewRateLimitingQueue(workqueue.DefaultControllerRateLimiter()),
+
 		k8sClient: mlu.InitClientSet(),
 	}
 }
 
 func (d *Dsmlu) SyncDsmlu() {
-	resyncPeriod := 60 * time.Second
 	stopCh := make(chan struct{})
 	defer close(stopCh)
+	defer d.queue.ShutDown()
 
-	go wait.Until(d.exec, resyncPeriod, stopCh)
-
-	podWatcher := cache.NewFilteredListWatchFromClient(
-		d.k8sClient.CoreV1().RESTClient(),
-		"pods",
-		metav1.NamespaceAll,
-		func(options *metav1.ListOptions) {
-			options.FieldSelector = fields.OneTermEqualSelector("spec.nodeName", d.option.NodeName).String()
-		},
-	)
-	_, controller := cache.NewInformer(
-		podWatcher,
-		&v1.Pod{},
-		resyncPeriod,
+	pods := informer.ForNode(d.k8sClient, d.option.NodeName).Pods()
+	registration, err := pods.AddEventHandler(
 		cache.ResourceEventHandlerFuncs{
+			AddFunc: func(obj interface{}) {
+				d.enqueueSlots(d.desired.update(obj.(*v1.Pod)))
+			},
+			UpdateFunc: func(_, newObj interface{}) {
+				d.enqueueSlots(d.desired.update(newObj.(*v1.Pod)))
+			},
 			DeleteFunc: func(obj interface{}) {
-				pod := obj.(*v1.Pod)
+				pod, ok := obj.(*v1.Pod)
+				if !ok {
+					tombstone, ok := obj.(cache.DeletedFinalStateUnknown)
+					if !ok {
+						return
+					}
+					if pod, ok = tombstone.Obj.(*v1.Pod); !ok {
+						return
+					}
+				}
 				if matchResource(pod) {
 					log.Debugf("Find pod use dsmlu %s is being deleted", pod.Name)
 					d.recycleProfileAndInstance(pod)
 					d.fixNodeLock(pod)
 				}
+				d.enqueueSlots(d.desired.remove(pod.UID))
 			},
 		},
 	)
-	go controller.Run(stopCh)
+	if err != nil {
+		log.Errorf("Failed to watch pods on node %s: %v", d.option.NodeName, err)
+		return
+	}
+
+	// The desired state is only complete after the initial list, reconciling
+	// before that would destroy instances which are still in use.
+	if !cache.WaitForCacheSync(stopCh, registration.HasSynced) {
+		log.Errorf("Failed to sync pod cache on node %s", d.option.NodeName)
+		return
+	}
+
+	workers := d.option.DsmluGCWorkers
+	if workers <= 0 {
+		workers = defaultGCWorkers
+	}
+	log.Printf("Start %d workers to reconcile dsmlu", workers)
+	for i := 0; i < workers; i++ {
+		go wait.Until(d.runWorker, time.Second, stopCh)
+	}
+	go wait.Until(d.enqueueAll, fullResyncPeriod, stopCh)
 	<-stopCh
 }
 
+func (d *Dsmlu) enqueueSlots(slots []int) {
+	for _, slot := range slots {
+		if slot < 0 {
+			continue
+		}
+		d.queue.Add(uint(slot))
+	}
+}
+
+func (d *Dsmlu) enqueueAll() {
+	num, err := cndev.GetDeviceCount()
+	if err != nil {
+		log.Errorf("Failed to get device count, err: %v", err)
+		return
+	}
+	for i := uint(0); i < num; i++ {
+		d.queue.Add(i)
+	}
+}
+
+func (d *Dsmlu) runWorker() {
+	for d.processNextSlot() {
+	}
+}
+
+func (d *Dsmlu) processNextSlot() bool {
+	key, quit := d.queue.Get()
+	if quit {
+		return false
+	}
+	defer d.queue.Done(key)
+
+	slot := key.(uint)
+	start := time.Now()
+	result, err := d.reconcileSlot(slot)
+	recordGC(slot, time.Since(start), result, err)
+	switch {
+	case err == nil:
+		d.queue.Forget(key)
+	case errors.Is(err, errSlotBusy):
+		log.Debugf("Found pending pod in handling on slot %d, retry later", slot)
+		d.queue.AddAfter(key, busyRetryPeriod)
+	default:
+		log.Errorf("Failed to reconcile smlu for slot %d, err: %v", slot, err)
+		d.queue.AddRateLimited(key)
+	}
+	return true
+}
+
 func (d *Dsmlu) fixNodeLock(pod *v1.Pod) {
 	if assigned, ok := pod.ObjectMeta.Annotations[mlu.DsmluResourceAssigned]; !ok ||
 		assigned != "false" || (pod.Status.Phase != v1.PodPending && pod.Status.Phase != v1.PodFailed) {
@@ -114,10 +205,6 @@ func (d *Dsmlu) fixNodeLock(pod *v1.Pod) {
 }
 
 func (d *Dsmlu) recycleProfileAndInstance(pod *v1.Pod) {
-
-	d.executeLock.Lock()
-	defer d.executeLock.Unlock()
-
 	anno, ok := pod.Annotations[mlu.DsmluProfileAndInstance]
 	if !ok || pod.DeletionTimestamp == nil {
 		return
@@ -125,21 +212,16 @@ func (d *Dsmlu) recycleProfileAndInstance(pod *v1.Pod) {
 
 	log.Debugf("Try to recycle instance from pod %s use dsmlu with annotation %s", pod.Name, anno)
 
-	v := strings.Split(anno, "_")
-	if len(v) != 4 {
-		log.Errorf("Invalid pod annotation %s", anno)
-		return
-	}
-	profile, err := strconv.Atoi(v[0])
+	record, err := parseInstanceRecord(anno)
 	if err != nil {
-		log.Errorf("Strconv value %s, %v", v[0], err)
-		return
-	}
-	instance, err := strconv.Atoi(v[1])
-	if err != nil {
-		log.Errorf("Strconv value %s, %v", v[1], err)
+		log.Errorf("Invalid pod annotation %s, err: %v", anno, err)
 		return
 	}
+	profile, instance := record.profileID, record.instanceHandle
+
+	cndev.SmluLock(uint(record.slot)).Lock()
+	defer cndev.SmluLock(uint(record.slot)).Unlock()
+	defer metrics.DsmluOperationDuration.ObserveSince(time.Now(), "destroy")
 
 	log.Debugf("Try to recycle instance %d from pod %s use dsmlu", instance, pod.Name)
 	if err := cndev.DestroySmlu(instance); err != nil {
@@ -180,110 +262,89 @@ func matchResource(pod *v1.Pod) bool {
 	return found
 }
 
-func (d *Dsmlu) exec() {
-
-	d.executeLock.Lock()
-	defer d.executeLock.Unlock()
-
-	selector := fields.SelectorFromSet(fields.Set{"spec.nodeName": d.option.NodeName})
-	podList, err := d.k8sClient.CoreV1().Pods(v1.NamespaceAll).List(context.TODO(), metav1.ListOptions{
-		FieldSelector: selector.String(),
-	})
+// reconcileSlot destroys the smlu instances and profiles on the slot which
+// are no longer referenced by any pod. Failures on one instance or profile
+// do not stop the others from being destroyed, they are joined and returned
+// so the slot is retried. Slots are reconciled concurrently, each under the
+// smlu lock of its slot which Allocate holds while creating instances.
+func (d *Dsmlu) reconcileSlot(slot uint) (gcResult, error) {
+	var result gcResult
+	enabled, err := d.slotSmluEnabled(slot)
 	if err != nil {
-		log.Errorf("Failed to list pod on node %s, err: %v", d.option.NodeName, err)
-		return
+		return result, fmt.Errorf("get smlu mode: %v", err)
 	}
-
-	toKeepInstances := make(map[int]map[int]struct{})
-	toKeepProfiles := make(map[int]map[int]struct{})
-	for _, pod := range podList.Items {
-		if !matchResource(&pod) {
-			continue
-		}
-		if pod.Status.Phase != v1.PodPending && pod.Status.Phase != v1.PodRunning {
-			continue
-		}
-		anno, ok := pod.ObjectMeta.Annotations["CAMBRICON_DSMLU_PROFILE_INSTANCE"]
-		if !ok {
-			if pod.Status.Phase == v1.PodPending {
-				log.Debugf("Found pending pod %s in handling, retry exec later", pod.Name)
-				return
-			}
-			continue
-		}
-
-		v := strings.Split(anno, "_")
-		// 1_256_1_0 represents profileID_instanceHandle_slot_instanceID
-		if len(v) != 4 {
-			log.Printf("Found pod %s with invalid annotation %s, ignore it", pod.Name, anno)
-			continue
-		}
-		profileID, err := strconv.Atoi(v[0])
-		if err != nil {
-			log.Printf("strconv value %s, %v", v[0], err)
-			continue
-		}
-		slot, err := strconv.Atoi(v[2])
-		if err != nil {
-			log.Printf("strconv value %s, %v", v[2], err)
-			continue
-		}
-		instanceID, err := strconv.Atoi(v[3])
-		if err != nil {
-			log.Printf("strconv value %s, %v", v[3], err)
-			continue
-		}
-		if toKeepInstances[slot] == nil {
-			toKeepInstances[slot] = make(map[int]struct{})
-		}
-		toKeepInstances[slot][instanceID] = struct{}{}
-		if toKeepProfiles[slot] == nil {
-			toKeepProfiles[slot] = make(map[int]struct{})
-		}
-		toKeepProfiles[slot][profileID] = struct{}{}
+	if !enabled {
+		log.Debugf("Smlu mode is disabled for slot %d, skip", slot)
+		return result, nil
 	}
 
-	num, err := cndev.GetDeviceCount()
+	cndev.SmluLock(slot).Lock()
+	defer cndev.SmluLock(slot).Unlock()
+	// Instances created by Allocate are forgotten once a pod recording them
+	// is in the desired state, so they must be read first.
+	toKeepInstances, toKeepProfiles := mlu.PendingSmlu(int(slot))
+	instances, profiles, busy := d.desired.slot(int(slot))
+	if busy {
+		return result, errSlotBusy
+	}
+	for id := range instances {
+		toKeepInstances[id] = struct{}{}
+	}
+	for id := range profiles {
+		toKeepProfiles[id] = struct{}{}
+	}
+	smluInfos, err := cndev.GetAllSmluInfo(slot)
 	if err != nil {
-		log.Errorf("Failed to get device count, err: %v", err)
-		return
+		return result, fmt.Errorf("get smlu info: %v", err)
 	}
-	for i := uint(0); i < num; i++ {
-		enabled, err := cndev.DeviceSmluModeEnabled(i)
-		if err != nil {
-			log.Errorf("Failed to get smlu mode for slot %d, err: %v", i, err)
-			continue
-		}
-		if !enabled {
-			log.Debugf("Smlu mode is disabled for slot %d, skip", i)
-			continue
-		}
-		smluInfos, err := cndev.GetAllSmluInfo(i)
-		if err != nil {
-			log.Errorf("Failed to get smlu info, err: %v", err)
-			return
-		}
-		for _, smluInfo := range smluInfos {
-			if _, ok := toKeepInstances[int(i)][smluInfo.InstanceID]; !ok {
-				instanceHandle := smluInfo.InstanceID<<8 | int(i)
-				log.Debugf("Found legacy smlu instance %d for slot %d, try to destroy it", smluInfo.InstanceID, i)
-				if err := cndev.DestroySmlu(instanceHandle); err != nil {
-					log.Errorf("Failed to destroy smlu with instance handle %d err %v", instanceHandle, err)
-				}
+	var errs []error
+	for _, smluInfo := range smluInfos {
+		if _, ok := toKeepInstances[smluInfo.InstanceID]; !ok {
+			instanceHandle := smluInfo.InstanceID<<8 | int(slot)
+			log.Debugf("Found legacy smlu instance %d for slot %d, try to destroy it", smluInfo.InstanceID, slot)
+			if err := cndev.DestroySmlu(instanceHandle); err != nil {
+				errs = append(errs, fmt.Errorf("destroy smlu with instance handle %d: %v", instanceHandle, err))
+				continue
 			}
+			result.instances++
 		}
-		profileInfos, err := cndev.GetDeviceProfileInfo(i)
-		if err != nil {
-			log.Errorf("Failed to get profile info, err: %v", err)
-			return
-		}
-		for _, profileInfo := range profileInfos {
-			if _, ok := toKeepProfiles[int(i)][profileInfo.ProfileID]; !ok {
-				log.Debugf("Found legacy smlu profile %d for device %d, try to destroy it", profileInfo.ProfileID, i)
-				if err := cndev.DestroySmluProfile(uint(profileInfo.ProfileID), i); err != nil {
-					log.Errorf("Failed to recycle smlu profile %d for device %d, err %v", profileInfo.ProfileID, i, err)
-				}
+	}
+	profileInfos, err := cndev.GetDeviceProfileInfo(slot)
+	if err != nil {
+		errs = append(errs, fmt.Errorf("get profile info: %v", err))
+		return result, errors.Join(errs...)
+	}
+	for _, profileInfo := range profileInfos {
+		if _, ok := toKeepProfiles[profileInfo.ProfileID]; !ok {
+			log.Debugf("Found legacy smlu profile %d for device %d, try to destroy it", profileInfo.ProfileID, slot)
+			if err := cndev.DestroySmluProfile(uint(profileInfo.ProfileID), slot); err != nil {
+				errs = append(errs, fmt.Errorf("destroy smlu profile %d: %v", profileInfo.ProfileID, err))
+				continue
 			}
+			result.profiles++
 		}
 	}
+	return result, errors.Join(errs...)
+}
+
+// InvalidateSmluModes forgets the cached smlu mode of every slot and
+// reconciles them all again, it must be called when the driver is reloaded.
+func (d *Dsmlu) InvalidateSmluModes() {
+	d.smluEnabled.Range(func(slot, _ interface{}) bool {
+		d.smluEnabled.Delete(slot)
+		return true
+	})
+	d.enqueueAll()
+}
+
+func (d *Dsmlu) slotSmluEnabled(slot uint) (bool, error) {
+	if enabled, ok := d.smluEnabled.Load(slot); ok {
+		return enabled.(bool), nil
+	}
+	enabled, err := cndev.DeviceSmluModeEnabled(slot)
+	if err != nil {
+		return false, err
+	}
+	d.smluEnabled.Store(slot, enabled)
+	return enabled, nil
 }
@@ -0,0 +1,195 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package dsmlu
+
+import (
+	"fmt"
+	"strconv"
+	"strings"
+	"sync"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/mlu"
+	log "github.com/sirupsen/logrus"
+	v1 "k8s.io/api/core/v1"
+	"k8s.io/apimachinery/pkg/types"
+)
+
+// instanceRecord is parsed from annotation like 1_256_1_0,
+// which represents profileID_instanceHandle_slot_instanceID.
+type instanceRecord struct {
+	profileID      int
+	instanceHandle int
+	slot           int
+	instanceID     int
+}
+
+func parseInstanceRecord(anno string) (instanceRecord, error) {
+	v := strings.Split(anno, "_")
+	if len(v) != 4 {
+		return instanceRecord{}, fmt.Errorf("invalid annotation %s", anno)
+	}
+	var values [4]int
+	for i := range v {
+		n, err := strconv.Atoi(v[i])
+		if err != nil {
+			return instanceRecord{}, fmt.Errorf("strconv value %s, %v", v[i], err)
+		}
+		values[i] = n
+	}
+	return instanceRecord{
+		profileID:      values[0],
+		instanceHandle: values[1],
+		slot:           values[2],
+		instanceID:     values[3],
+	}, nil
+}
+
+// anySlot marks a pending pod whose slot is unknown, no slot may be garbage
+// collected until it is allocated or gone.
+const anySlot = -2
+
+// podState is what a single pod contributes to the desired state of the node.
+// A pod either holds an instance, or is pending on a slot without its instance
+// annotated yet, in which case the slot must not be garbage collected.
+type podState struct {
+	record  *instanceRecord
+	pending int
+}
+
+func (p podState) slots() []int {
+	if p.record != nil {
+		return []int{p.record.slot}
+	}
+	if p.pending >= 0 {
+		return []int{p.pending}
+	}
+	return nil
+}
+
+func (p podState) equal(o podState) bool {
+	if p.pending != o.pending {
+		return false
+	}
+	if p.record == nil || o.record == nil {
+		return p.record == o.record
+	}
+	return *p.record == *o.record
+}
+
+func newPodState(pod *v1.Pod) (podState, bool) {
+	state := podState{pending: -1}
+	if !matchResource(pod) {
+		return state, false
+	}
+	if pod.Status.Phase != v1.PodPending && pod.Status.Phase != v1.PodRunning {
+		return state, false
+	}
+	anno, ok := pod.ObjectMeta.Annotations[mlu.DsmluProfileAndInstance]
+	if !ok {
+		if pod.Status.Phase != v1.PodPending {
+			return state, false
+		}
+		pl, err := mlu.GetProfileFromAnnotation(pod)
+		if err != nil {
+			log.Printf("Found pending pod %s with invalid profile annotation, hold gc on all slots, err: %v", pod.Name, err)
+			state.pending = anySlot
+			return state, true
+		}
+		state.pending = pl.Slot
+		return state, true
+	}
+	record, err := parseInstanceRecord(anno)
+	if err != nil {
+		log.Printf("Found pod %s with invalid annotation %s, ignore it, err: %v", pod.Name, anno, err)
+		return state, false
+	}
+	state.record = &record
+	return state, true
+}
+
+// desiredState indexes, per slot, the smlu instances and profiles which are
+// still referenced by pods on this node.
+type desiredState struct {
+	sync.RWMutex
+	pods map[types.UID]podState
+}
+
+func newDesiredState() *desiredState {
+	return &desiredState{pods: map[types.UID]podState{}}
+}
+
+// update records the pod and returns the slots whose desired state changed.
+func (s *desiredState) update(pod *v1.Pod) []int {
+	s.Lock()
+	defer s.Unlock()
+
+	old, existed := s.pods[pod.UID]
+	state, ok := newPodState(pod)
+	if !ok {
+		if !existed {
+			return nil
+		}
+		delete(s.pods, pod.UID)
+		return old.slots()
+	}
+	if existed && old.equal(state) {
+		return nil
+	}
+	s.pods[pod.UID] = state
+	if state.record != nil {
+		mlu.ForgetPendingSmlu(state.record.slot, state.record.instanceID)
+	}
+	if !existed {
+		return state.slots()
+	}
+	return append(old.slots(), state.slots()...)
+}
+
+// remove forgets the pod and returns the slots whose desired state changed.
+func (s *desiredState) remove(uid types.UID) []int {
+	s.Lock()
+	defer s.Unlock()
+
+	old, ok := s.pods[uid]
+	if !ok {
+		return nil
+	}
+	delete(s.pods, uid)
+	return old.slots()
+}
+
+// slot returns the instances and profiles to keep on the slot, busy is true
+// if a pod is still being allocated on it.
+func (s *desiredState) slot(slot int) (instances map[int]struct{}, profiles map[int]struct{}, busy bool) {
+	s.RLock()
+	defer s.RUnlock()
+
+	instances = map[int]struct{}{}
+	profiles = map[int]struct{}{}
+	for _, state := range s.pods {
+		if state.record == nil {
+			if state.pending == slot || state.pending == anySlot {
+				busy = true
+			}
+			continue
+		}
+		if state.record.slot != slot {
+			continue
+		}
+		instances[state.record.instanceID] = struct{}{}
+		profiles[state.record.profileID] = struct{}{}
+	}
+	return instances, profiles, busy
+}
@@ -0,0 +1,134 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package dsmlu
+
+import (
+	"errors"
+	"testing"
+	"time"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/mlu"
+	"github.com/agiledragon/gomonkey/v2"
+	"github.com/stretchr/testify/assert"
+	v1 "k8s.io/api/core/v1"
+	metav1 "k8s.io/apimachinery/pkg/apis/meta/v1"
+	"k8s.io/apimachinery/pkg/types"
+	"k8s.io/client-go/util/workqueue"
+)
+
+func newDsmluPod(uid string, phase v1.PodPhase, annotations map[string]string) *v1.Pod {
+	return &v1.Pod{
+		ObjectMeta: metav1.ObjectMeta{
+			Name:        uid,
+			UID:         types.UID(uid),
+			Annotations: annotations,
+		},
+		Status: v1.PodStatus{Phase: phase},
+	}
+}
+
+func TestParseInstanceRecord(t *testing.T) {
+	record, err := parseInstanceRecord("1_256_1_0")
+	assert.NoError(t, err)
+	assert.Equal(t, instanceRecord{profileID: 1, instanceHandle: 256, slot: 1, instanceID: 0}, record)
+
+	_, err = parseInstanceRecord("1_256_1")
+	assert.Error(t, err)
+	_, err = parseInstanceRecord("1_a_1_0")
+	assert.Error(t, err)
+}
+
+func TestDesiredState(t *testing.T) {
+	s := newDesiredState()
+
+	running := newDsmluPod("running", v1.PodRunning, map[string]string{
+		mlu.DsmluProfile:            "1_2_5",
+		mlu.DsmluProfileAndInstance: "3_513_1_2",
+	})
+	assert.Equal(t, []int{1}, s.update(running))
+	// status only changes should not trigger reconciliation
+	assert.Nil(t, s.update(running.DeepCopy()))
+
+	pending := newDsmluPod("pending", v1.PodPending, map[string]string{
+		mlu.DsmluProfile: "0_2_5",
+	})
+	assert.Equal(t, []int{0}, s.update(pending))
+
+	instances, profiles, busy := s.slot(1)
+	assert.Equal(t, map[int]struct{}{2: {}}, instances)
+	assert.Equal(t, map[int]struct{}{3: {}}, profiles)
+	assert.False(t, busy)
+	_, _, busy = s.slot(0)
+	assert.True(t, busy)
+
+	// pending pod gets its instance on slot 0
+	allocated := pending.DeepCopy()
+	allocated.Annotations[mlu.DsmluProfileAndInstance] = "0_256_0_1"
+	assert.Equal(t, []int{0, 0}, s.update(allocated))
+	instances, _, busy = s.slot(0)
+	assert.Equal(t, map[int]struct{}{1: {}}, instances)
+	assert.False(t, busy)
+
+	succeeded := running.DeepCopy()
+	succeeded.Status.Phase = v1.PodSucceeded
+	assert.Equal(t, []int{1}, s.update(succeeded))
+	instances, profiles, _ = s.slot(1)
+	assert.Empty(t, instances)
+	assert.Empty(t, profiles)
+
+	assert.Equal(t, []int{0}, s.remove(allocated.UID))
+	assert.Nil(t, s.remove(allocated.UID))
+
+	// a pending pod with an unparsable profile holds gc on every slot
+	invalid := newDsmluPod("invalid", v1.PodPending, map[string]string{
+		mlu.DsmluProfile: "0_2",
+	})
+	assert.Nil(t, s.update(invalid))
+	_, _, busy = s.slot(1)
+	assert.True(t, busy)
+	assert.Nil(t, s.remove(invalid.UID))
+	_, _, busy = s.slot(1)
+	assert.False(t, busy)
+}
+
+func TestRecordGC(t *testing.T) {
+	recordGC(100, time.Second, gcResult{instances: 2, profiles: 1}, nil)
+	recordGC(100, 3*time.Second, gcResult{instances: 1}, errors.New("destroy failed"))
+	recordGC(101, time.Second, gcResult{}, errSlotBusy)
+
+	assert.Equal(t, uint64(2), metrics.DsmluGCDuration.Count("100"))
+	assert.Equal(t, float64(1), metrics.DsmluGCFailures.Value("100"))
+	assert.Equal(t, float64(3), metrics.DsmluGCDestroyed.Value("100", "instance"))
+	assert.Equal(t, float64(1), metrics.DsmluGCDestroyed.Value("100", "profile"))
+	assert.Equal(t, uint64(0), metrics.DsmluGCDuration.Count("101"))
+}
+
+func TestInvalidateSmluModes(t *testing.T) {
+	stub := gomonkey.ApplyFunc(cndev.GetDeviceCount, func() (uint, error) { return 2, nil })
+	defer stub.Reset()
+	d := &Dsmlu{queue: workqueue.NewRateLimitingQueue(workqueue.DefaultControllerRateLimiter())}
+	defer d.queue.ShutDown()
+
+	d.smluEnabled.Store(uint(0), true)
+	d.smluEnabled.Store(uint(1), false)
+	d.InvalidateSmluModes()
+	_, ok := d.smluEnabled.Load(uint(0))
+	assert.False(t, ok)
+	_, ok = d.smluEnabled.Load(uint(1))
+	assert.False(t, ok)
+	assert.Equal(t, 2, d.queue.Len())
+}
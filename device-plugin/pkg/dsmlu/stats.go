@@ -0,0 +1,57 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package dsmlu
+
+import (
+	"errors"
+	"strconv"
+	"time"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
+	log "github.com/sirupsen/logrus"
+)
+
+// gcResult is the number of smlu instances and profiles destroyed in one reconcile.
+type gcResult struct {
+	instances int
+	profiles  int
+}
+
+// recordGC exports the timing and outcome of one slot reconcile, runs
+// skipped because the slot is busy are not counted.
+func recordGC(slot uint, duration time.Duration, result gcResult, err error) {
+	if errors.Is(err, errSlotBusy) {
+		return
+	}
+
+	label := strconv.FormatUint(uint64(slot), 10)
+	metrics.DsmluGCDuration.Observe(duration.Seconds(), label)
+	if err != nil {
+		metrics.DsmluGCFailures.Inc(label)
+	}
+	if result.instances > 0 {
+		metrics.DsmluGCDestroyed.Add(float64(result.instances), label, "instance")
+	}
+	if result.profiles > 0 {
+		metrics.DsmluGCDestroyed.Add(float64(result.profiles), label, "profile")
+	}
+
+	if result.instances > 0 || result.profiles > 0 {
+		log.Printf("Reconciled smlu for slot %d in %v, destroyed %d instances and %d profiles",
+			slot, duration, result.instances, result.profiles)
+		return
+	}
+	log.Debugf("Reconciled smlu for slot %d in %v", slot, duration)
+}
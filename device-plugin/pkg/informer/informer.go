@@ -0,0 +1,95 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Package informer provides the watches on objects bound to this node,
+// shared by every subsystem of the plugin.
+package informer
+
+import (
+	"sync"
+
+	metav1 "k8s.io/apimachinery/pkg/apis/meta/v1"
+	"k8s.io/apimachinery/pkg/fields"
+	"k8s.io/client-go/informers"
+	"k8s.io/client-go/kubernetes"
+	listersv1 "k8s.io/client-go/listers/core/v1"
+	"k8s.io/client-go/tools/cache"
+)
+
+// Node holds the informers scoped to a single node. Informers are started on
+// first use and run for the lifetime of the process.
+type Node struct {
+	nodeName string
+	nodes    informers.SharedInformerFactory
+	pods     informers.SharedInformerFactory
+	stopCh   chan struct{}
+}
+
+var (
+	shared     *Node
+	sharedOnce sync.Once
+)
+
+// New returns informers watching the node nodeName and the pods bound to it.
+func New(client kubernetes.Interface, nodeName string) *Node {
+	return &Node{
+		nodeName: nodeName,
+		nodes: informers.NewSharedInformerFactoryWithOptions(client, 0,
+			informers.WithTweakListOptions(func(options *metav1.ListOptions) {
+				options.FieldSelector = fields.OneTermEqualSelector("metadata.name", nodeName).String()
+			})),
+		pods: informers.NewSharedInformerFactoryWithOptions(client, 0,
+			informers.WithTweakListOptions(func(options *metav1.ListOptions) {
+				options.FieldSelector = fields.OneTermEqualSelector("spec.nodeName", nodeName).String()
+			})),
+		stopCh: make(chan struct{}),
+	}
+}
+
+// ForNode returns the informers shared by the whole process, created with
+// the arguments of the first call.
+func ForNode(client kubernetes.Interface, nodeName string) *Node {
+	sharedOnce.Do(func() {
+		shared = New(client, nodeName)
+	})
+	return shared
+}
+
+// Nodes returns the informer of the node itself, its cache holds a single object.
+func (n *Node) Nodes() cache.SharedIndexInformer {
+	informer := n.nodes.Core().V1().Nodes().Informer()
+	n.nodes.Start(n.stopCh)
+	return informer
+}
+
+// Pods returns the informer of the pods bound to the node.
+func (n *Node) Pods() cache.SharedIndexInformer {
+	informer := n.pods.Core().V1().Pods().Informer()
+	n.pods.Start(n.stopCh)
+	return informer
+}
+
+// PodLister returns a lister backed by the pod informer, it is only complete
+// once the informer has synced.
+func (n *Node) PodLister() listersv1.PodLister {
+	n.Pods()
+	return n.pods.Core().V1().Pods().Lister()
+}
+
+// Stop stops all informers, it is only meant for tests.
+func (n *Node) Stop() {
+	close(n.stopCh)
+	n.nodes.Shutdown()
+	n.pods.Shutdown()
+}
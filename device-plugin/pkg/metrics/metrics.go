@@ -0,0 +1,53 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package metrics
+
+import "net/http"
+
+const namespace = "cambricon_device_plugin_"
+
+// Default is the registry served on /metrics.
+var Default = NewRegistry()
+
+var (
+	AllocateDuration = NewHistogram(Default, namespace+"allocate_duration_seconds",
+		"Latency of Allocate calls from kubelet.", DefBuckets, "profile")
+	GetPreferredAllocationDuration = NewHistogram(Default, namespace+"get_preferred_allocation_duration_seconds",
+		"Latency of GetPreferredAllocation calls from kubelet.", DefBuckets, "profile")
+	PrepareResponseDuration = NewHistogram(Default, namespace+"prepare_response_duration_seconds",
+		"Latency of preparing the container allocate response.", DefBuckets, "profile")
+	GetRingsDuration = NewHistogram(Default, namespace+"cntopo_get_rings_duration_seconds",
+		"Latency of cntopo GetRings calls.", DefBuckets)
+	CndevCallDuration = NewHistogram(Default, namespace+"cndev_call_duration_seconds",
+		"Latency of cndev binding calls.", DefBuckets, "call")
+	DsmluOperationDuration = NewHistogram(Default, namespace+"dsmlu_operation_duration_seconds",
+		"Latency of dynamic smlu create and destroy.", DefBuckets, "operation")
+	DsmluGCDuration = NewHistogram(Default, namespace+"dsmlu_gc_duration_seconds",
+		"Latency of dynamic smlu garbage collection of a slot.", DefBuckets, "slot")
+
+	Timeouts = NewCounter(Default, namespace+"timeouts_total",
+		"Number of operations which exceeded their deadline.", "operation")
+	HealthTransitions = NewCounter(Default, namespace+"health_transitions_total",
+		"Number of device health state transitions.", "to")
+	DsmluGCDestroyed = NewCounter(Default, namespace+"dsmlu_gc_destroyed_total",
+		"Number of orphaned dynamic smlu instances and profiles destroyed by garbage collection.", "slot", "kind")
+	DsmluGCFailures = NewCounter(Default, namespace+"dsmlu_gc_failures_total",
+		"Number of failed dynamic smlu garbage collections of a slot.", "slot")
+)
+
+// Handler serves the default registry.
+func Handler() http.Handler {
+	return Default.Handler()
+}
@@ -0,0 +1,287 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Package metrics implements the small subset of the Prometheus text
+// exposition format needed by the device plugin, counters and histograms
+// with labels, without pulling in the Prometheus client library.
+package metrics
+
+import (
+	"bufio"
+	"fmt"
+	"io"
+	"math"
+	"net/http"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"time"
+)
+
+// DefBuckets are the default histogram buckets in seconds, same as the Prometheus client.
+var DefBuckets = []float64{.005, .01, .025, .05, .1, .25, .5, 1, 2.5, 5, 10}
+
+type collector interface {
+	name() string
+	write(w io.Writer)
+}
+
+// Registry holds the collectors exposed by Handler.
+type Registry struct {
+	sync.RWMutex
+	collectors map[string]collector
+}
+
+// NewRegistry returns an empty registry.
+func NewRegistry() *Registry {
+	return &Registry{collectors: map[string]collector{}}
+}
+
+func (r *Registry) register(c collector) {
+	r.Lock()
+	defer r.Unlock()
+	if _, ok := r.collectors[c.name()]; ok {
+		panic(fmt.Sprintf("metric %s registered twice", c.name()))
+	}
+	r.collectors[c.name()] = c
+}
+
+// Write writes all collectors in text exposition format, sorted by metric name.
+func (r *Registry) Write(w io.Writer) error {
+	r.RLock()
+	names := make([]string, 0, len(r.collectors))
+	for name := range r.collectors {
+		names = append(names, name)
+	}
+	sort.Strings(names)
+	collectors := make([]collector, 0, len(names))
+	for _, name := range names {
+		collectors = append(collectors, r.collectors[name])
+	}
+	r.RUnlock()
+
+	bw := bufio.NewWriter(w)
+	for _, c := range collectors {
+		c.write(bw)
+	}
+	return bw.Flush()
+}
+
+// Handler serves the registry for Prometheus to scrape.
+func (r *Registry) Handler() http.Handler {
+	return http.HandlerFunc(func(w http.ResponseWriter, _ *http.Request) {
+		w.Header().Set("Content-Type", "text/plain; version=0.0.4; charset=utf-8")
+		r.Write(w)
+	})
+}
+
+// series keeps label values in registration order for a labelled metric.
+type series struct {
+	sync.Mutex
+	labelNames []string
+	values     map[string][]string
+}
+
+func (s *series) key(labelValues []string) string {
+	if len(labelValues) != len(s.labelNames) {
+		panic(fmt.Sprintf("expected %d label values, got %d", len(s.labelNames), len(labelValues)))
+	}
+	return strings.Join(labelValues, "\xff")
+}
+
+func (s *series) sortedKeys() []string {
+	keys := make([]string, 0, len(s.values))
+	for k := range s.values {
+		keys = append(keys, k)
+	}
+	sort.Strings(keys)
+	return keys
+}
+
+func (s *series) labels(key string, extra ...string) string {
+	values := s.values[key]
+	if len(values) == 0 && len(extra) == 0 {
+		return ""
+	}
+	pairs := make([]string, 0, len(values)+1)
+	for i, v := range values {
+		pairs = append(pairs, s.labelNames[i]+`="`+labelValueEscaper.Replace(v)+`"`)
+	}
+	for i := 0; i+1 < len(extra); i += 2 {
+		pairs = append(pairs, extra[i]+`="`+labelValueEscaper.Replace(extra[i+1])+`"`)
+	}
+	return "{" + strings.Join(pairs, ",") + "}"
+}
+
+// The text format only allows \\, \" and \n escapes in label values, and
+// \\ and \n in help text, other characters are written as they are.
+var (
+	labelValueEscaper = strings.NewReplacer(`\`, `\\`, `"`, `\"`, "\n", `\n`)
+	helpEscaper       = strings.NewReplacer(`\`, `\\`, "\n", `\n`)
+)
+
+func formatFloat(v float64) string {
+	switch {
+	case math.IsInf(v, 1):
+		return "+Inf"
+	case math.IsInf(v, -1):
+		return "-Inf"
+	}
+	return strconv.FormatFloat(v, 'g', -1, 64)
+}
+
+// Counter is a monotonically increasing value partitioned by labels.
+type Counter struct {
+	series
+	metricName string
+	help       string
+	counts     map[string]float64
+}
+
+// NewCounter creates a counter and registers it in r.
+func NewCounter(r *Registry, name, help string, labelNames ...string) *Counter {
+	c := &Counter{
+		series:     series{labelNames: labelNames, values: map[string][]string{}},
+		metricName: name,
+		help:       help,
+		counts:     map[string]float64{},
+	}
+	r.register(c)
+	return c
+}
+
+func (c *Counter) name() string { return c.metricName }
+
+// Inc increments the counter by 1.
+func (c *Counter) Inc(labelValues ...string) {
+	c.Add(1, labelValues...)
+}
+
+// Add adds v, which must not be negative, to the counter.
+func (c *Counter) Add(v float64, labelValues ...string) {
+	if v < 0 {
+		panic("counter cannot decrease")
+	}
+	key := c.key(labelValues)
+	c.Lock()
+	defer c.Unlock()
+	if _, ok := c.values[key]; !ok {
+		c.values[key] = append([]string(nil), labelValues...)
+	}
+	c.counts[key] += v
+}
+
+// Value returns the current value of the counter.
+func (c *Counter) Value(labelValues ...string) float64 {
+	key := c.key(labelValues)
+	c.Lock()
+	defer c.Unlock()
+	return c.counts[key]
+}
+
+func (c *Counter) write(w io.Writer) {
+	c.Lock()
+	defer c.Unlock()
+	fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s counter\n", c.metricName, helpEscaper.Replace(c.help), c.metricName)
+	for _, key := range c.sortedKeys() {
+		fmt.Fprintf(w, "%s%s %s\n", c.metricName, c.labels(key), formatFloat(c.counts[key]))
+	}
+}
+
+type histogramValue struct {
+	buckets []uint64
+	count   uint64
+	sum     float64
+}
+
+// Histogram counts observations into cumulative buckets partitioned by labels.
+type Histogram struct {
+	series
+	metricName string
+	help       string
+	upper      []float64
+	hist       map[string]*histogramValue
+}
+
+// NewHistogram creates a histogram with the given upper bounds and registers it in r.
+func NewHistogram(r *Registry, name, help string, buckets []float64, labelNames ...string) *Histogram {
+	upper := append([]float64(nil), buckets...)
+	sort.Float64s(upper)
+	h := &Histogram{
+		series:     series{labelNames: labelNames, values: map[string][]string{}},
+		metricName: name,
+		help:       help,
+		upper:      upper,
+		hist:       map[string]*histogramValue{},
+	}
+	r.register(h)
+	return h
+}
+
+func (h *Histogram) name() string { return h.metricName }
+
+// Observe adds a single observation.
+func (h *Histogram) Observe(v float64, labelValues ...string) {
+	key := h.key(labelValues)
+	h.Lock()
+	defer h.Unlock()
+	hv, ok := h.hist[key]
+	if !ok {
+		h.values[key] = append([]string(nil), labelValues...)
+		hv = &histogramValue{buckets: make([]uint64, len(h.upper))}
+		h.hist[key] = hv
+	}
+	if i := sort.SearchFloat64s(h.upper, v); i < len(h.upper) {
+		hv.buckets[i]++
+	}
+	hv.count++
+	hv.sum += v
+}
+
+// ObserveSince observes the seconds elapsed since start, meant to be deferred
+// at the beginning of the measured function:
+//
+//	defer metrics.AllocateDuration.ObserveSince(time.Now(), profile)
+func (h *Histogram) ObserveSince(start time.Time, labelValues ...string) {
+	h.Observe(time.Since(start).Seconds(), labelValues...)
+}
+
+// Count returns the number of observations.
+func (h *Histogram) Count(labelValues ...string) uint64 {
+	key := h.key(labelValues)
+	h.Lock()
+	defer h.Unlock()
+	if hv, ok := h.hist[key]; ok {
+		return hv.count
+	}
+	return 0
+}
+
+func (h *Histogram) write(w io.Writer) {
+	h.Lock()
+	defer h.Unlock()
+	fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s histogram\n", h.metricName, helpEscaper.Replace(h.help), h.metricName)
+	for _, key := range h.sortedKeys() {
+		hv := h.hist[key]
+		var cumulative uint64
+		for i, upper := range h.upper {
+			cumulative += hv.buckets[i]
+			fmt.Fprintf(w, "%s_bucket%s %d\n", h.metricName, h.labels(key, "le", formatFloat(upper)), cumulative)
+		}
+		fmt.Fprintf(w, "%s_bucket%s %d\n", h.metricName, h.labels(key, "le", "+Inf"), hv.count)
+		fmt.Fprintf(w, "%s_sum%s %s\n", h.metricName, h.labels(key), formatFloat(hv.sum))
+		fmt.Fprintf(w, "%s_count%s %d\n", h.metricName, h.labels(key), hv.count)
+	}
+}
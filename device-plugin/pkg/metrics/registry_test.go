@@ -0,0 +1,80 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package metrics
+
+import (
+	"bytes"
+	"net/http/httptest"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestRegistryWrite(t *testing.T) {
+	r := NewRegistry()
+	h := NewHistogram(r, "test_duration_seconds", "Test histogram.", []float64{1, 0.1}, "call")
+	c := NewCounter(r, "test_total", "Test counter.", "to")
+
+	h.Observe(0.05, "a")
+	h.Observe(0.1, "a")
+	h.Observe(3, "a")
+	c.Inc("Healthy")
+	c.Add(2, "Unhealthy")
+
+	assert.Equal(t, uint64(3), h.Count("a"))
+	assert.Equal(t, uint64(0), h.Count("b"))
+	assert.Equal(t, float64(2), c.Value("Unhealthy"))
+
+	var buf bytes.Buffer
+	assert.NoError(t, r.Write(&buf))
+	assert.Equal(t, `# HELP test_duration_seconds Test histogram.
+# TYPE test_duration_seconds histogram
+test_duration_seconds_bucket{call="a",le="0.1"} 2
+test_duration_seconds_bucket{call="a",le="1"} 2
+test_duration_seconds_bucket{call="a",le="+Inf"} 3
+test_duration_seconds_sum{call="a"} 3.15
+test_duration_seconds_count{call="a"} 3
+# HELP test_total Test counter.
+# TYPE test_total counter
+test_total{to="Healthy"} 1
+test_total{to="Unhealthy"} 2
+`, buf.String())
+
+	rec := httptest.NewRecorder()
+	r.Handler().ServeHTTP(rec, httptest.NewRequest("GET", "/metrics", nil))
+	assert.Equal(t, buf.String(), rec.Body.String())
+	assert.Contains(t, rec.Header().Get("Content-Type"), "version=0.0.4")
+}
+
+func TestRegistryPanics(t *testing.T) {
+	r := NewRegistry()
+	c := NewCounter(r, "dup_total", "Dup.", "a")
+	assert.Panics(t, func() { NewCounter(r, "dup_total", "Dup.") })
+	assert.Panics(t, func() { c.Inc() })
+	assert.Panics(t, func() { c.Add(-1, "x") })
+}
+
+func TestRegistryEscape(t *testing.T) {
+	r := NewRegistry()
+	c := NewCounter(r, "escape_total", "Line one\nback\\slash \"quoted\".", "err")
+	c.Inc("a\\b \"c\"\nd\te\x01é")
+
+	var buf bytes.Buffer
+	assert.NoError(t, r.Write(&buf))
+	assert.Equal(t, `# HELP escape_total Line one\nback\\slash "quoted".
+# TYPE escape_total counter
+escape_total{err="a\\b \"c\"\nd`+"\te\x01é"+`"} 1
+`, buf.String())
+}
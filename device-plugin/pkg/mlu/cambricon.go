@@ -19,9 +19,11 @@ import (
 	"fmt"
 	"path/filepath"
 	"strings"
+	"sync"
 	"time"
 
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
 	log "github.com/sirupsen/logrus"
 	pluginapi "k8s.io/kubelet/pkg/apis/deviceplugin/v1beta1"
 )
@@ -67,6 +69,21 @@ func check(err error) {
 	}
 }
 
+// numaTopology returns the topology of a device on numa, nil when the
+// driver does not know the node.
+func numaTopology(numa int) *pluginapi.TopologyInfo {
+	if numa < 0 {
+		return nil
+	}
+	return &pluginapi.TopologyInfo{
+		Nodes: []*pluginapi.NUMANode{
+			{
+				ID: int64(numa),
+			},
+		},
+	}
+}
+
 func generateFakeDevs(origin *cndev.Device, num int, mode pluginMode) ([]*pluginapi.Device, map[string]*cndev.Device) {
 	devs := []*pluginapi.Device{}
 	devsInfo := make(map[string]*cndev.Device)
@@ -80,14 +97,16 @@ func generateFakeDevs(origin *cndev.Device, num int, mode pluginMode) ([]*plugin
 			uuid = fmt.Sprintf("%s-%s-%d", origin.UUID, origin.Profile, i+1)
 		}
 		devsInfo[uuid] = &cndev.Device{
+			Numa:    origin.Numa,
 			Slot:    origin.Slot,
 			UUID:    uuid,
 			Path:    path,
 			Profile: origin.Profile,
 		}
 		devs = append(devs, &pluginapi.Device{
-			ID:     uuid,
-			Health: pluginapi.Healthy,
+			ID:       uuid,
+			Health:   pluginapi.Healthy,
+			Topology: numaTopology(origin.Numa),
 		})
 	}
 
@@ -95,27 +114,102 @@ func generateFakeDevs(origin *cndev.Device, num int, mode pluginMode) ([]*plugin
 	return devs, devsInfo
 }
 
-func scanMimDevs(origin *cndev.Device, idx uint) ([]*pluginapi.Device, map[string]*cndev.Device) {
+func scanMimDevs(origin *cndev.Device, idx uint) ([]*pluginapi.Device, map[string]*cndev.Device, error) {
 	devs := []*pluginapi.Device{}
 	devsInfo := make(map[string]*cndev.Device)
 	infos, err := cndev.GetAllMluInstanceInfo(idx)
-	check(err)
+	if err != nil {
+		return nil, nil, err
+	}
 	for _, info := range infos {
 		uid := origin.UUID + "-mim-" + info.UUID
 		devsInfo[uid] = &cndev.Device{
+			Numa:    origin.Numa,
 			Slot:    origin.Slot,
 			UUID:    uid,
 			Path:    fmt.Sprintf("%s%d", mluDeviceName, origin.Slot) + "," + info.IpcmDevNodeName + "," + info.DevNodeName, // device name should never contain ","
 			Profile: strings.ReplaceAll(info.Name, "+", "-"),
 		}
 		devs = append(devs, &pluginapi.Device{
-			ID:     uid,
-			Health: pluginapi.Healthy,
+			ID:       uid,
+			Health:   pluginapi.Healthy,
+			Topology: numaTopology(origin.Numa),
 		})
 	}
 
 	log.Debugf("scanMimDevs devs: %+v\n devsinfo: %+v", devs, devsInfo)
-	return devs, devsInfo
+	return devs, devsInfo, nil
+}
+
+// slotDevices holds the devices discovered on one slot.
+type slotDevices struct {
+	devs     []*pluginapi.Device
+	devsInfo map[string]*cndev.Device
+}
+
+func (s *slotDevices) add(devs []*pluginapi.Device, devsInfo map[string]*cndev.Device) {
+	s.devs = append(s.devs, devs...)
+	for k, v := range devsInfo {
+		s.devsInfo[k] = v
+	}
+}
+
+// discoverSlot builds the devices of a single slot from its probe, only
+// mim mode queries the driver here. It is safe to run concurrently for
+// different slots.
+func discoverSlot(o Options, p slotProbe) (slotDevices, error) {
+	s := slotDevices{devsInfo: map[string]*cndev.Device{}}
+	i := p.Device.Slot
+	device := p.Device
+	d := &device
+
+	realCountDevice := *d
+	realCountDevice.Profile = realCounts
+	s.devsInfo[realCounts+"-"+realCountDevice.UUID] = &realCountDevice
+	s.devs = append(s.devs, &pluginapi.Device{
+		ID:       realCounts + "-" + realCountDevice.UUID,
+		Health:   pluginapi.Healthy,
+		Topology: numaTopology(d.Numa),
+	})
+
+	switch o.Mode {
+	case EnvShare:
+		s.add(generateFakeDevs(d, o.VirtualizationNum, o.Mode))
+	case DynamicSmlu:
+		dev := *d
+		// fake ipu uuid
+		dev.Profile = "vcore"
+		num := 100
+		s.add(generateFakeDevs(&dev, num, o.Mode))
+		// fake memory uuid
+		dev.Profile = "vmemory"
+		if o.MinDsmluUnit > 0 {
+			num = int(p.Memory) / o.MinDsmluUnit
+		}
+		s.add(generateFakeDevs(&dev, num, o.Mode))
+	case Mim:
+		enabled, err := cndev.DeviceMimModeEnabled(i)
+		if err != nil {
+			return s, err
+		}
+		if enabled {
+			devices, infos, err := scanMimDevs(d, i)
+			if err != nil {
+				return s, err
+			}
+			s.add(devices, infos)
+			break
+		}
+		fallthrough
+	default:
+		s.devsInfo[d.UUID] = d
+		s.devs = append(s.devs, &pluginapi.Device{
+			ID:       d.UUID,
+			Health:   pluginapi.Healthy,
+			Topology: numaTopology(d.Numa),
+		})
+	}
+	return s, nil
 }
 
 func GetDevices(o Options) (map[string][]*pluginapi.Device, map[string]map[string]*cndev.Device) {
@@ -123,76 +217,24 @@ func GetDevices(o Options) (map[string][]*pluginapi.Device, map[string]map[strin
 	devsInfo := make(map[string]*cndev.Device)
 	num, err := cndev.GetDeviceCount()
 	check(err)
+	if o.Mode == EnvShare && o.VirtualizationNum < 1 {
+		check(fmt.Errorf("invalid env-share number %d", o.VirtualizationNum))
+	}
 
-	for i := uint(0); i < num; i++ {
-		d, err := cndev.NewDeviceLite(i)
-		check(err)
-
-		realCountDevice := *d
-		realCountDevice.Profile = realCounts
-		devsInfo[realCounts+"-"+realCountDevice.UUID] = &realCountDevice
-		devs = append(devs, &pluginapi.Device{
-			ID:     realCounts + "-" + realCountDevice.UUID,
-			Health: pluginapi.Healthy,
-		})
-
-		switch o.Mode {
-		case EnvShare:
-			if o.VirtualizationNum < 1 {
-				check(fmt.Errorf("invalid env-share number %d", o.VirtualizationNum))
-			}
-			devices, infos := generateFakeDevs(d, o.VirtualizationNum, o.Mode)
-			devs = append(devs, devices...)
-			for k, v := range infos {
-				devsInfo[k] = v
-			}
-		case DynamicSmlu:
-			dev := *d
-			// fake ipu uuid
-			dev.Profile = "vcore"
-			num := 100
-			devices, infos := generateFakeDevs(&dev, num, o.Mode)
-			devs = append(devs, devices...)
-			for k, v := range infos {
-				devsInfo[k] = v
-			}
-			// fake memory uuid
-			dev.Profile = "vmemory"
-			if o.MinDsmluUnit > 0 {
-				mem, err := cndev.GetDeviceMemory(i)
-				check(err)
-				num = int(mem) / o.MinDsmluUnit
-			}
-			devices, infos = generateFakeDevs(&dev, num, o.Mode)
-			devs = append(devs, devices...)
-			for k, v := range infos {
-				devsInfo[k] = v
-			}
-		case Mim:
-			enabled, err := cndev.DeviceMimModeEnabled(i)
-			check(err)
-			if enabled {
-				devices, infos := scanMimDevs(d, i)
-				devs = append(devs, devices...)
-				for k, v := range infos {
-					devsInfo[k] = v
-				}
-				break
-			}
-			fallthrough
-		default:
-			devsInfo[d.UUID] = d
-			devs = append(devs, &pluginapi.Device{
-				ID:     d.UUID,
-				Health: pluginapi.Healthy,
-				Topology: &pluginapi.TopologyInfo{
-					Nodes: []*pluginapi.NUMANode{
-						{
-							ID: int64(d.Numa),
-						},
-					},
-				},
-			})
+	// Slots are queried concurrently, results are merged in slot order
+	// so the device list is the same as a serial scan.
+	probes, err := probeSlots(o, num)
+	check(err)
+	results := make([]slotDevices, num)
+	check(cndev.ForEachSlot(num, cndev.DiscoveryWorkers, func(i uint) error {
+		var err error
+		results[i], err = discoverSlot(o, probes[i])
+		return err
+	}))
+	for _, r := range results {
+		devs = append(devs, r.devs...)
+		for k, v := range r.devsInfo {
+			devsInfo[k] = v
 		}
 	}
 	log.Debugf("GetDevices devs: %+v\n devsinfo: %+v", devs, devsInfo)
@@ -208,7 +250,37 @@ func deviceExists(devs []*pluginapi.Device, id string) bool {
 	return false
 }
 
-func watchUnhealthy(ctx context.Context, devsInfo map[string]*cndev.Device, health chan<- *pluginapi.Device) {
+// healthKicker wakes up every health check waiting for its next round.
+type healthKicker struct {
+	sync.Mutex
+	ch chan struct{}
+}
+
+var healthKicks = &healthKicker{ch: make(chan struct{})}
+
+func (k *healthKicker) wait() <-chan struct{} {
+	k.Lock()
+	defer k.Unlock()
+	return k.ch
+}
+
+func (k *healthKicker) kick() {
+	k.Lock()
+	defer k.Unlock()
+	close(k.ch)
+	k.ch = make(chan struct{})
+}
+
+// KickHealthChecks makes all health checks run their next round now, used
+// when a device event is received.
+func KickHealthChecks() {
+	healthKicks.kick()
+}
+
+// watchUnhealthy polls the health of devsInfo every interval or when kicked,
+// and calls sweep after every round in which the driver answered for at
+// least one device.
+func watchUnhealthy(ctx context.Context, devsInfo map[string]*cndev.Device, health chan<- *pluginapi.Device, interval time.Duration, sweep func()) {
 	unhealthy := make(map[string]bool)
 	var getDeviceComputeModeDisabled bool
 	for {
@@ -219,12 +291,15 @@ func watchUnhealthy(ctx context.Context, devsInfo map[string]*cndev.Device, heal
 		}
 
 		omitDupCall := map[uint]int{}
+		reachable := false
 		for _, dm := range devsInfo {
 			if _, ok := omitDupCall[dm.Slot]; !ok {
 				ret, _, _, err := cndev.GetDeviceHealthState(dm.Slot, 1)
 				if err != nil {
 					log.Warnf("Failed to get Device %s healthy status with err %v, set it as unhealthy", dm.UUID, err)
 					ret = 0
+				} else {
+					reachable = true
 				}
 				if ret == 1 && !getDeviceComputeModeDisabled {
 					computeMode, err := cndev.GetDeviceComputeMode(dm.Slot, 1)
@@ -249,6 +324,7 @@ func watchUnhealthy(ctx context.Context, devsInfo map[string]*cndev.Device, heal
 					Health: pluginapi.Unhealthy,
 				}
 				log.Debugf("Device %s health state changes from health to unhealth in time %s", dm.UUID, time.Now())
+				metrics.HealthTransitions.Inc(pluginapi.Unhealthy)
 				health <- &dev
 			} else if unhealthy[dm.UUID] {
 				delete(unhealthy, dm.UUID)
@@ -257,12 +333,21 @@ func watchUnhealthy(ctx context.Context, devsInfo map[string]*cndev.Device, heal
 					Health: pluginapi.Healthy,
 				}
 				log.Debugf("Device %s health state changes from unhealth to health in time %s", dm.UUID, time.Now())
+				metrics.HealthTransitions.Inc(pluginapi.Healthy)
 				health <- &dev
 			}
 		}
 
-		//Sleep 1 second between two health checks
-		time.Sleep(time.Second)
+		if reachable {
+			sweep()
+		}
+
+		select {
+		case <-ctx.Done():
+			return
+		case <-time.After(interval):
+		case <-healthKicks.wait():
+		}
 	}
 }
 
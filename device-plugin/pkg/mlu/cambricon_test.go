@@ -109,6 +109,31 @@ func TestGenerateFakeDevs(t *testing.T) {
 	assert.Equal(t, uint(1), devsInfo[fmt.Sprintf("%s-%s-2", d.UUID, "vcore")].Slot)
 }
 
+func TestGetDevicesTopology(t *testing.T) {
+	// mock.json puts slots 0-3 on numa node 0 and slots 4-7 on node 1
+	for _, o := range []Options{
+		{Mode: Default},
+		{Mode: EnvShare, VirtualizationNum: 2},
+		{Mode: Mim},
+		{Mode: DynamicSmlu, MinDsmluUnit: 256},
+	} {
+		devsM, devsInfoM := GetDevices(o)
+		for profile, devs := range devsM {
+			for _, dev := range devs {
+				info := devsInfoM[profile][dev.ID]
+				assert.Equal(t, int(info.Slot/4), info.Numa, dev.ID)
+				if assert.NotNil(t, dev.Topology, dev.ID) && assert.Len(t, dev.Topology.Nodes, 1, dev.ID) {
+					assert.Equal(t, int64(info.Slot/4), dev.Topology.Nodes[0].ID, dev.ID)
+				}
+			}
+		}
+	}
+
+	d := &cndev.Device{Slot: 1, UUID: "MLU-20001012-1916-0000-0000-000000000000", Numa: -1}
+	devs, _ := generateFakeDevs(d, 1, EnvShare)
+	assert.Nil(t, devs[0].Topology)
+}
+
 func TestHostDeviceExistsWithPrefix(t *testing.T) {
 	filename := "/tmp/cambricon_dev0"
 	prefix := "/tmp/cambricon_dev"
@@ -121,3 +146,14 @@ func TestHostDeviceExistsWithPrefix(t *testing.T) {
 	res = hostDeviceExistsWithPrefix(prefix)
 	assert.Equal(t, res, false)
 }
+
+func BenchmarkGetDevices(b *testing.B) {
+	for _, mode := range []pluginMode{Default, EnvShare, Mim} {
+		b.Run(string(mode), func(b *testing.B) {
+			o := Options{Mode: mode, VirtualizationNum: 2}
+			for i := 0; i < b.N; i++ {
+				GetDevices(o)
+			}
+		})
+	}
+}
@@ -14,7 +14,11 @@
 
 package mlu
 
-import pluginapi "k8s.io/kubelet/pkg/apis/deviceplugin/v1beta1"
+import (
+	"time"
+
+	pluginapi "k8s.io/kubelet/pkg/apis/deviceplugin/v1beta1"
+)
 
 type pluginMode string
 
@@ -55,8 +59,21 @@ const (
 	mluUARTConsoleDeviceName = "/dev/ttyMS"
 )
 
+const (
+	healthCheckInterval = time.Second
+	// with uevents, device loss is noticed from events and polling is only a fallback
+	ueventHealthCheckInterval = 10 * time.Second
+	// utilization of env-share cards used to weight preferred allocation
+	utilizationSampleInterval = 5 * time.Second
+)
+
 const (
 	bestEffort string = "best-effort"
 	restricted string = "restricted"
 	guaranteed string = "guaranteed"
 )
+
+const (
+	mimPack   string = "pack"
+	mimSpread string = "spread"
+)
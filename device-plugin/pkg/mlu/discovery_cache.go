@@ -0,0 +1,219 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"crypto/sha256"
+	"encoding/hex"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"os"
+	"path/filepath"
+	"reflect"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	log "github.com/sirupsen/logrus"
+)
+
+// discoveryCacheVersion must be bumped whenever slotProbe or discoveryKey changes.
+const discoveryCacheVersion = 2
+
+// discoveryKey identifies the hardware and driver a snapshot was taken on,
+// a snapshot is only reused when the key matches exactly. UUIDs catch a card
+// swapped into the same PCIe slot, which keeps its BDF.
+type discoveryKey struct {
+	BDFs          []string   `json:"bdfs"`
+	DeviceCount   uint       `json:"deviceCount"`
+	DriverVersion string     `json:"driverVersion"`
+	Mode          pluginMode `json:"mode"`
+	UUIDs         []string   `json:"uuids"`
+}
+
+// slotProbe is what discovery learns from the driver about one slot.
+type slotProbe struct {
+	Device cndev.Device `json:"device"`
+	Memory uint         `json:"memory,omitempty"`
+}
+
+type discoveryPayload struct {
+	Key   discoveryKey `json:"key"`
+	Slots []slotProbe  `json:"slots"`
+}
+
+type discoveryFile struct {
+	Version  int             `json:"version"`
+	Checksum string          `json:"checksum"`
+	Payload  json.RawMessage `json:"payload"`
+}
+
+func checksum(data []byte) string {
+	sum := sha256.Sum256(data)
+	return hex.EncodeToString(sum[:])
+}
+
+func currentDiscoveryKey(o Options, count uint) (discoveryKey, error) {
+	bdfs, err := cndev.FetchMLUBDFs()
+	if err != nil {
+		return discoveryKey{}, fmt.Errorf("fetch bdfs: %v", err)
+	}
+	_, _, _, major, minor, build, err := cndev.GetDeviceVersion(0)
+	if err != nil {
+		return discoveryKey{}, fmt.Errorf("get driver version: %v", err)
+	}
+	uuids := make([]string, count)
+	err = cndev.ForEachSlot(count, cndev.DiscoveryWorkers, func(i uint) error {
+		var err error
+		uuids[i], err = cndev.GetDeviceUUID(i)
+		return err
+	})
+	if err != nil {
+		return discoveryKey{}, fmt.Errorf("get uuids: %v", err)
+	}
+	return discoveryKey{
+		BDFs:          bdfs,
+		DeviceCount:   count,
+		DriverVersion: fmt.Sprintf("v%d.%d.%d", major, minor, build),
+		Mode:          o.Mode,
+		UUIDs:         uuids,
+	}, nil
+}
+
+func loadDiscoveryCache(path string, key discoveryKey) ([]slotProbe, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	var f discoveryFile
+	if err := json.Unmarshal(data, &f); err != nil {
+		return nil, fmt.Errorf("decode cache: %v", err)
+	}
+	if f.Version != discoveryCacheVersion {
+		return nil, fmt.Errorf("cache version %d, expected %d", f.Version, discoveryCacheVersion)
+	}
+	if checksum(f.Payload) != f.Checksum {
+		return nil, errors.New("cache checksum mismatch")
+	}
+	var p discoveryPayload
+	if err := json.Unmarshal(f.Payload, &p); err != nil {
+		return nil, fmt.Errorf("decode cache payload: %v", err)
+	}
+	if !reflect.DeepEqual(p.Key, key) {
+		return nil, fmt.Errorf("cache key %+v does not match %+v", p.Key, key)
+	}
+	if uint(len(p.Slots)) != key.DeviceCount {
+		return nil, fmt.Errorf("cache has %d slots, expected %d", len(p.Slots), key.DeviceCount)
+	}
+	for i := range p.Slots {
+		if p.Slots[i].Device.Slot != uint(i) {
+			return nil, fmt.Errorf("cache slot %d recorded as %d", i, p.Slots[i].Device.Slot)
+		}
+	}
+	return p.Slots, nil
+}
+
+// saveDiscoveryCache writes the snapshot through a temporary file and a
+// rename, so a crash never leaves a truncated cache behind.
+func saveDiscoveryCache(path string, key discoveryKey, slots []slotProbe) error {
+	payload, err := json.Marshal(discoveryPayload{Key: key, Slots: slots})
+	if err != nil {
+		return err
+	}
+	data, err := json.Marshal(discoveryFile{
+		Version:  discoveryCacheVersion,
+		Checksum: checksum(payload),
+		Payload:  payload,
+	})
+	if err != nil {
+		return err
+	}
+	if err := os.MkdirAll(filepath.Dir(path), 0755); err != nil {
+		return err
+	}
+	tmp, err := os.CreateTemp(filepath.Dir(path), filepath.Base(path)+".tmp")
+	if err != nil {
+		return err
+	}
+	defer os.Remove(tmp.Name())
+	if _, err := tmp.Write(data); err != nil {
+		tmp.Close()
+		return err
+	}
+	if err := tmp.Sync(); err != nil {
+		tmp.Close()
+		return err
+	}
+	if err := tmp.Close(); err != nil {
+		return err
+	}
+	return os.Rename(tmp.Name(), path)
+}
+
+// probeSlots returns the driver facts of every slot, from the discovery
+// cache when it is enabled and still valid, or by enumerating the driver.
+func probeSlots(o Options, count uint) ([]slotProbe, error) {
+	// mim instances can be changed without a driver reload, always scan them.
+	useCache := o.DiscoveryCachePath != "" && o.Mode != Mim
+	var key discoveryKey
+	if useCache {
+		var err error
+		key, err = currentDiscoveryKey(o, count)
+		if err != nil {
+			log.Warnf("Failed to get discovery cache key, skip cache: %v", err)
+			useCache = false
+		}
+	}
+	if useCache {
+		probes, err := loadDiscoveryCache(o.DiscoveryCachePath, key)
+		if err == nil {
+			log.Printf("Loaded %d devices from discovery cache %s", len(probes), o.DiscoveryCachePath)
+			return probes, nil
+		}
+		if !os.IsNotExist(err) {
+			log.Printf("Discovery cache %s is invalid, enumerate devices: %v", o.DiscoveryCachePath, err)
+		}
+	}
+
+	probes := make([]slotProbe, count)
+	err := cndev.ForEachSlot(count, cndev.DiscoveryWorkers, func(i uint) error {
+		var err error
+		probes[i], err = probeSlot(o, i)
+		return err
+	})
+	if err != nil {
+		return nil, err
+	}
+
+	if useCache {
+		if err := saveDiscoveryCache(o.DiscoveryCachePath, key, probes); err != nil {
+			log.Warnf("Failed to save discovery cache %s: %v", o.DiscoveryCachePath, err)
+		}
+	}
+	return probes, nil
+}
+
+func probeSlot(o Options, i uint) (slotProbe, error) {
+	d, err := cndev.NewDeviceLite(i)
+	if err != nil {
+		return slotProbe{}, err
+	}
+	p := slotProbe{Device: *d}
+	if o.Mode == DynamicSmlu {
+		if p.Memory, err = cndev.GetDeviceMemory(i); err != nil {
+			return slotProbe{}, err
+		}
+	}
+	return p, nil
+}
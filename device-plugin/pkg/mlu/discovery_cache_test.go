@@ -0,0 +1,116 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"fmt"
+	"os"
+	"path/filepath"
+	"strings"
+	"sync/atomic"
+	"testing"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	"github.com/agiledragon/gomonkey/v2"
+	"github.com/stretchr/testify/assert"
+)
+
+func TestDiscoveryCache(t *testing.T) {
+	path := filepath.Join(t.TempDir(), "cache", "discovery.json")
+	key := discoveryKey{
+		BDFs:          []string{"0000:1a:00.0", "0000:3d:00.0"},
+		DeviceCount:   2,
+		DriverVersion: "v5.10.22",
+		Mode:          Default,
+		UUIDs:         []string{"MLU-0", "MLU-1"},
+	}
+	slots := []slotProbe{
+		{Device: cndev.Device{Slot: 0, UUID: "MLU-0", Path: "/dev/cambricon_dev0"}},
+		{Device: cndev.Device{Slot: 1, UUID: "MLU-1", Path: "/dev/cambricon_dev1", Numa: 1}},
+	}
+
+	_, err := loadDiscoveryCache(path, key)
+	assert.True(t, os.IsNotExist(err))
+
+	assert.NoError(t, saveDiscoveryCache(path, key, slots))
+	loaded, err := loadDiscoveryCache(path, key)
+	assert.NoError(t, err)
+	assert.Equal(t, slots, loaded)
+
+	changed := key
+	changed.DriverVersion = "v5.10.23"
+	_, err = loadDiscoveryCache(path, changed)
+	assert.Error(t, err)
+	changed = key
+	changed.BDFs = []string{"0000:1a:00.0", "0000:3e:00.0"}
+	_, err = loadDiscoveryCache(path, changed)
+	assert.Error(t, err)
+	// a card swapped into the same slot keeps its bdf
+	changed = key
+	changed.UUIDs = []string{"MLU-0", "MLU-9"}
+	_, err = loadDiscoveryCache(path, changed)
+	assert.Error(t, err)
+
+	data, err := os.ReadFile(path)
+	assert.NoError(t, err)
+	assert.NoError(t, os.WriteFile(path, []byte(strings.Replace(string(data), "MLU-1", "MLU-2", 1)), 0644))
+	_, err = loadDiscoveryCache(path, key)
+	assert.EqualError(t, err, "cache checksum mismatch")
+
+	entries, err := os.ReadDir(filepath.Dir(path))
+	assert.NoError(t, err)
+	assert.Len(t, entries, 1)
+}
+
+func TestGetDevicesWithDiscoveryCache(t *testing.T) {
+	var probed int32
+	stub := gomonkey.ApplyFunc(cndev.FetchMLUBDFs, func() ([]string, error) {
+		return []string{"0000:01:00.0", "0000:02:00.0", "0000:03:00.0", "0000:04:00.0",
+			"0000:05:00.0", "0000:06:00.0", "0000:07:00.0", "0000:08:00.0"}, nil
+	})
+	defer stub.Reset()
+	uuid := func(i uint) string { return fmt.Sprintf("MLU-%d", i) }
+	stub.ApplyFunc(cndev.GetDeviceUUID, func(i uint) (string, error) {
+		return uuid(i), nil
+	})
+	stub.ApplyFunc(cndev.NewDeviceLite, func(i uint) (*cndev.Device, error) {
+		atomic.AddInt32(&probed, 1)
+		return &cndev.Device{
+			Slot: i,
+			UUID: uuid(i),
+			Path: fmt.Sprintf("/dev/cambricon_dev%d", i),
+		}, nil
+	})
+
+	o := Options{Mode: Default, DiscoveryCachePath: filepath.Join(t.TempDir(), "discovery.json")}
+	devsM, devsInfoM := GetDevices(o)
+	assert.Equal(t, int32(8), probed)
+
+	cachedDevsM, cachedDevsInfoM := GetDevices(o)
+	assert.Equal(t, int32(8), probed)
+	assert.Equal(t, devsM, cachedDevsM)
+	assert.Equal(t, devsInfoM, cachedDevsInfoM)
+
+	// swap the card in slot 3
+	uuid = func(i uint) string {
+		if i == 3 {
+			return "MLU-swapped"
+		}
+		return fmt.Sprintf("MLU-%d", i)
+	}
+	_, devsInfoM = GetDevices(o)
+	assert.Equal(t, int32(16), probed)
+	assert.Contains(t, devsInfoM[normalMlu], "MLU-swapped")
+}
@@ -0,0 +1,140 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"container/heap"
+	"fmt"
+	"strconv"
+	"strings"
+	"sync"
+
+	log "github.com/sirupsen/logrus"
+)
+
+const envShareSeparator = "-_-"
+
+// envShareID is an env-share device id, the card uuid and the virtual
+// device number joined by envShareSeparator.
+type envShareID struct {
+	uuid string
+	vf   int
+}
+
+// envShareIDs caches parsed ids, the ids of a card never change.
+var envShareIDs = struct {
+	sync.RWMutex
+	ids map[string]envShareID
+}{ids: map[string]envShareID{}}
+
+func parseEnvShareID(id string) (envShareID, error) {
+	envShareIDs.RLock()
+	p, ok := envShareIDs.ids[id]
+	envShareIDs.RUnlock()
+	if ok {
+		return p, nil
+	}
+
+	uuid, _, _ := strings.Cut(id, envShareSeparator)
+	num := id
+	if i := strings.LastIndex(id, envShareSeparator); i >= 0 {
+		num = id[i+len(envShareSeparator):]
+	}
+	vf, err := strconv.Atoi(num)
+	if err != nil {
+		log.Errorf("Convert value to int, error %v, value %s", err, num)
+		return envShareID{}, err
+	}
+	p = envShareID{uuid: uuid, vf: vf}
+	envShareIDs.Lock()
+	envShareIDs.ids[id] = p
+	envShareIDs.Unlock()
+	return p, nil
+}
+
+// envShareCard is the available virtual devices of one card.
+type envShareCard struct {
+	uuid  string
+	free  int
+	minVF int
+	score int
+}
+
+// envShareHeap pops the card with the highest score first, ties by uuid.
+type envShareHeap []*envShareCard
+
+func (h envShareHeap) Len() int { return len(h) }
+func (h envShareHeap) Less(i, j int) bool {
+	if h[i].score != h[j].score {
+		return h[i].score > h[j].score
+	}
+	return h[i].uuid < h[j].uuid
+}
+func (h envShareHeap) Swap(i, j int)       { h[i], h[j] = h[j], h[i] }
+func (h *envShareHeap) Push(x interface{}) { *h = append(*h, x.(*envShareCard)) }
+func (h *envShareHeap) Pop() interface{} {
+	old := *h
+	n := len(old)
+	c := old[n-1]
+	*h = old[:n-1]
+	return c
+}
+
+// preferEnvShare takes the lowest virtual device of each of the size best
+// cards. A card scores its free virtual devices weighted by how idle it is,
+// free*(100-utilization), utilization is 0 for all cards if util is nil.
+// The cards are rebuilt from the available ids of each request instead of
+// being kept on the plugin: the plugin is not told when a container
+// releases its devices, so only the kubelet's available set is reliable.
+// A request costs one pass over the ids and size pops of the card heap.
+func preferEnvShare(available []string, size int, util func(uuid string) int) ([]string, error) {
+	index := map[string]*envShareCard{}
+	h := envShareHeap{}
+	for _, id := range available {
+		p, err := parseEnvShareID(id)
+		if err != nil {
+			return nil, err
+		}
+		c, ok := index[p.uuid]
+		if !ok {
+			c = &envShareCard{uuid: p.uuid, minVF: p.vf}
+			index[p.uuid] = c
+			h = append(h, c)
+		}
+		c.free++
+		if p.vf < c.minVF {
+			c.minVF = p.vf
+		}
+	}
+
+	if size > len(h) {
+		return nil, fmt.Errorf("can not get preferred devices since available is shorter than required, required:%d, available:%d", size, len(h))
+	}
+
+	for _, c := range h {
+		load := 0
+		if util != nil {
+			load = min(max(util(c.uuid), 0), 100)
+		}
+		c.score = c.free * (100 - load)
+	}
+	heap.Init(&h)
+	res := make([]string, 0, size)
+	for i := 0; i < size; i++ {
+		c := heap.Pop(&h).(*envShareCard)
+		res = append(res, fmt.Sprintf("%s%s%d", c.uuid, envShareSeparator, c.minVF))
+	}
+	return res, nil
+}
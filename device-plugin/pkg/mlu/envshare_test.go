@@ -0,0 +1,90 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"fmt"
+	"testing"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	"github.com/stretchr/testify/assert"
+)
+
+func TestPreferEnvShare(t *testing.T) {
+	// card 0 has 4 free virtual devices, card 1 has 3 and card 2 has 1
+	available := []string{
+		"MLU-0-_-1", "MLU-0-_-2", "MLU-0-_-3", "MLU-0-_-4",
+		"MLU-1-_-4", "MLU-1-_-2", "MLU-1-_-3",
+		"MLU-2-_-2",
+	}
+	util := map[string]int{"MLU-0": 90, "MLU-1": 20, "MLU-2": 0}
+
+	ids, err := preferEnvShare(available, 1, nil)
+	assert.NoError(t, err)
+	assert.Equal(t, []string{"MLU-0-_-1"}, ids)
+
+	// 4*10 < 1*100 < 3*80
+	ids, err = preferEnvShare(available, 3, func(uuid string) int { return util[uuid] })
+	assert.NoError(t, err)
+	assert.Equal(t, []string{"MLU-1-_-2", "MLU-2-_-2", "MLU-0-_-1"}, ids)
+
+	// out of range utilization is clamped
+	ids, err = preferEnvShare(available, 2, func(uuid string) int { return 200 - util[uuid] })
+	assert.NoError(t, err)
+	assert.Equal(t, []string{"MLU-0-_-1", "MLU-1-_-2"}, ids)
+
+	_, err = preferEnvShare([]string{"MLU-0-_-x"}, 1, nil)
+	assert.Error(t, err)
+}
+
+func TestUtilizationSampler(t *testing.T) {
+	devsInfo := map[string]*cndev.Device{}
+	for slot := 0; slot < 3; slot++ {
+		d := &cndev.Device{Slot: uint(slot), UUID: fmt.Sprintf("MLU-%d", slot)}
+		_, infos := generateFakeDevs(d, 2, EnvShare)
+		for k, v := range infos {
+			devsInfo[k] = v
+		}
+	}
+	s := newUtilizationSampler(devsInfo)
+	assert.Equal(t, 0, s.get("MLU-1"))
+
+	// mock.json reports 80% for slot 1 and 10% for slot 2
+	n, err := s.sample()
+	assert.NoError(t, err)
+	assert.Equal(t, 3, n)
+	assert.Equal(t, 0, s.get("MLU-0"))
+	assert.Equal(t, 80, s.get("MLU-1"))
+	assert.Equal(t, 10, s.get("MLU-2"))
+
+	var stopped *utilizationSampler
+	assert.Equal(t, 0, stopped.get("MLU-1"))
+}
+
+func BenchmarkPreferEnvShare(b *testing.B) {
+	var available []string
+	for card := 0; card < 64; card++ {
+		for vf := 1; vf <= 16; vf++ {
+			available = append(available, fmt.Sprintf("MLU-%d-_-%d", card, vf))
+		}
+	}
+	util := func(string) int { return 50 }
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err := preferEnvShare(available, 4, util); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
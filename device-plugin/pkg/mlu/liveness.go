@@ -0,0 +1,114 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"fmt"
+	"sort"
+	"sync"
+	"time"
+)
+
+const (
+	// sweepStaleThreshold is how long a serving plugin may go without a
+	// health sweep that reached the driver before it is considered stuck.
+	sweepStaleThreshold = 5 * time.Minute
+	// notServingThreshold is how long the process may go without any plugin
+	// serving, which covers repeated start or register failures.
+	notServingThreshold = 10 * time.Minute
+)
+
+type pluginLiveness struct {
+	healthCheck bool
+	lastSweep   time.Time
+}
+
+// livenessTracker records the gRPC server state of every plugin and the
+// last health sweep, so liveness probes are answered without calling cndev.
+type livenessTracker struct {
+	sync.Mutex
+	now        func() time.Time
+	plugins    map[string]*pluginLiveness
+	lastChange time.Time
+}
+
+func newLivenessTracker(now func() time.Time) *livenessTracker {
+	return &livenessTracker{
+		now:        now,
+		plugins:    map[string]*pluginLiveness{},
+		lastChange: now(),
+	}
+}
+
+var liveness = newLivenessTracker(time.Now)
+
+func (l *livenessTracker) serving(socket string, healthCheck bool) {
+	l.Lock()
+	defer l.Unlock()
+	now := l.now()
+	l.plugins[socket] = &pluginLiveness{healthCheck: healthCheck, lastSweep: now}
+	l.lastChange = now
+}
+
+func (l *livenessTracker) stopped(socket string) {
+	l.Lock()
+	defer l.Unlock()
+	if _, ok := l.plugins[socket]; !ok {
+		return
+	}
+	delete(l.plugins, socket)
+	l.lastChange = l.now()
+}
+
+func (l *livenessTracker) sweep(socket string) {
+	l.Lock()
+	defer l.Unlock()
+	if p, ok := l.plugins[socket]; ok {
+		p.lastSweep = l.now()
+	}
+}
+
+func (l *livenessTracker) check() error {
+	l.Lock()
+	defer l.Unlock()
+	now := l.now()
+	if len(l.plugins) == 0 {
+		if d := now.Sub(l.lastChange); d > notServingThreshold {
+			return fmt.Errorf("no device plugin serving for %v", d.Round(time.Second))
+		}
+		return nil
+	}
+	sockets := make([]string, 0, len(l.plugins))
+	for socket := range l.plugins {
+		sockets = append(sockets, socket)
+	}
+	sort.Strings(sockets)
+	for _, socket := range sockets {
+		p := l.plugins[socket]
+		if !p.healthCheck {
+			continue
+		}
+		if d := now.Sub(p.lastSweep); d > sweepStaleThreshold {
+			return fmt.Errorf("no health sweep for plugin %s in %v", socket, d.Round(time.Second))
+		}
+	}
+	return nil
+}
+
+// CheckLiveness reports whether the plugins are serving and their health
+// checks are making progress. It only reads in-memory state.
+func CheckLiveness() error {
+	return liveness.check()
+}
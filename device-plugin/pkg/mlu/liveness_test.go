@@ -0,0 +1,52 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestLivenessTracker(t *testing.T) {
+	now := time.Unix(0, 0)
+	l := newLivenessTracker(func() time.Time { return now })
+
+	// waiting for plugins to start
+	now = now.Add(notServingThreshold)
+	assert.NoError(t, l.check())
+	now = now.Add(time.Second)
+	assert.Error(t, l.check())
+
+	l.serving("mlu.sock", true)
+	l.serving("real-mlu-counts.sock", false)
+	assert.NoError(t, l.check())
+
+	now = now.Add(sweepStaleThreshold)
+	l.sweep("mlu.sock")
+	now = now.Add(sweepStaleThreshold)
+	assert.NoError(t, l.check())
+	now = now.Add(time.Second)
+	assert.Error(t, l.check())
+
+	l.stopped("mlu.sock")
+	assert.NoError(t, l.check())
+	l.stopped("real-mlu-counts.sock")
+	now = now.Add(notServingThreshold)
+	assert.NoError(t, l.check())
+	now = now.Add(time.Second)
+	assert.Error(t, l.check())
+}
@@ -26,12 +26,18 @@ import (
 
 type Options struct {
 	CnmonPath           string     `long:"cnmon-path" description:"host cnmon path" json:"cnmonPath,omitempty"`
+	CntopoCachePath     string     `long:"cntopo-cache-path" description:"host file to cache the MLULink machine info probed by CNTOPO across restarts, used only in topology-aware mode, disabled if empty" json:"cntopoCachePath,omitempty"`
 	ConfigFile          string     `long:"config-file" description:"config file" env:"CONFIG_FILE"`
+	DiscoveryCachePath  string     `long:"discovery-cache-path" description:"host file to cache device discovery across restarts, must not be under the device plugin directory, disabled if empty" json:"discoveryCachePath,omitempty"`
 	DisableHealthCheck  bool       `long:"disable-health-check" description:"disable MLU health check" json:"disableHealthCheck,omitempty"`
+	DsmluGCWorkers      int        `long:"dsmlu-gc-workers" description:"number of workers reconciling smlu garbage collection of MLUs, used only in dynamic-smlu mode, 4 if not set" json:"dsmluGCWorkers,omitempty"`
 	EnableConsole       bool       `long:"enable-console" description:"enable UART console device(/dev/ttyMS) in container" json:"enableConsole,omitempty"`
 	EnableDeviceType    bool       `long:"enable-device-type" description:"enable device registration with type info" json:"enableDeviceType,omitempty"`
 	EnabledCDI          bool       `long:"enable-cdi" description:"enable CDI support" json:"enabledCDI,omitempty"`
+	FastReregister      bool       `long:"fast-reregister" description:"only register plugins again when kubelet restarts, keeping device state and health checks, instead of restarting all plugins" json:"fastReregister,omitempty"`
+	KubeletCheckpoint   bool       `long:"kubelet-checkpoint" description:"read MLUs in use from the kubelet device plugin checkpoint instead of the pod resources API, used only in topology-aware mode" json:"kubeletCheckpoint,omitempty"`
 	LogLevel            string     `long:"log-level" description:"set log level: trace/debug/info/warn/error/fatal/panic" default:"info" json:"logLevel,omitempty"`
+	MimAllocationPolicy string     `long:"mim-allocation-policy" description:"how preferred allocation places the instances of a request in mim mode, pack onto as few cards as possible or spread over cards, pack if not set" choice:"pack" choice:"spread" json:"mimAllocationPolicy,omitempty"`
 	MinDsmluUnit        int        `long:"min-dsmlu-unit" description:"minimum unit for dsmu, used only in dynamic-smlu mode" default:"0" env:"MIN-DSMLU-UNIT" json:"minDsmluUnit,omitempty"`
 	MLULinkPolicy       string     `long:"mlulink-policy" description:"MLULink topology policy" default:"best-effort" choice:"best-effort" choice:"restricted" choice:"guaranteed" json:"mluLinkPolicy,omitempty"`
 	Mode                pluginMode `long:"mode" description:"device plugin mode" default:"default" choice:"default" choice:"dynamic-smlu" choice:"env-share" choice:"mim" choice:"topology-aware" json:"mode,omitempty"`
@@ -39,6 +45,8 @@ type Options struct {
 	NodeName            string     `long:"node-name" description:"host node name" env:"NODE_NAME" json:"nodeName,omitempty"`
 	NodeLabel           bool       `long:"node-label" description:"enable node label for MLU devices" json:"nodeLabel,omitempty"`
 	OneShotForNodeLabel bool       `long:"one-shot-for-node-label" description:"enable one-shot mode for node label, only works when nodeLabel is enabled" json:"oneShotForNodeLabel,omitempty"`
+	PCIeAffinity        bool       `long:"pcie-affinity" description:"prefer MLUs under a common PCIe switch when MLULink rings are not used, used only in topology-aware mode" json:"pcieAffinity,omitempty"`
+	Uevent              bool       `long:"uevent" description:"listen to kernel uevents of MLU devices to react to hotplug and driver reload, requires host network" json:"uevent,omitempty"`
 	UseRuntime          bool       `long:"use-runtime" description:"only set enabled when cambricon container runtime is configed as the default runtime" json:"useRuntime,omitempty"`
 	Version             bool       `long:"version" description:"print out version"`
 	VirtualizationNum   int        `long:"virtualization-num" description:"the virtualization number for each MLU, used only in env-share mode" default:"1" env:"VIRTUALIZATION_NUM" json:"virtualizationNum,omitempty"`
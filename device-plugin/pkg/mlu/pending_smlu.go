@@ -0,0 +1,72 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"sync"
+	"time"
+)
+
+// pendingSmluTTL bounds how long an instance created by Allocate is kept
+// without any pod recording it, in case its pod is never annotated.
+var pendingSmluTTL = 10 * time.Minute
+
+type pendingSmlu struct {
+	profileID int
+	created   time.Time
+}
+
+// pendingSmlus remembers per slot the smlu instances created by Allocate
+// until a pod annotated with them is seen by the dsmlu garbage collector,
+// which would otherwise destroy them while its informer lags behind.
+var pendingSmlus = struct {
+	sync.Mutex
+	slots map[int]map[int]pendingSmlu
+}{slots: map[int]map[int]pendingSmlu{}}
+
+func addPendingSmlu(slot, instanceID, profileID int) {
+	pendingSmlus.Lock()
+	defer pendingSmlus.Unlock()
+	if pendingSmlus.slots[slot] == nil {
+		pendingSmlus.slots[slot] = map[int]pendingSmlu{}
+	}
+	pendingSmlus.slots[slot][instanceID] = pendingSmlu{profileID: profileID, created: time.Now()}
+}
+
+// PendingSmlu returns the instances and profiles created by Allocate on slot
+// which no pod is known to record yet. It must be called with the smlu lock
+// of the slot held, before the pods recording instances are looked up.
+func PendingSmlu(slot int) (instances map[int]struct{}, profiles map[int]struct{}) {
+	pendingSmlus.Lock()
+	defer pendingSmlus.Unlock()
+	instances = map[int]struct{}{}
+	profiles = map[int]struct{}{}
+	for instanceID, p := range pendingSmlus.slots[slot] {
+		if time.Since(p.created) > pendingSmluTTL {
+			delete(pendingSmlus.slots[slot], instanceID)
+			continue
+		}
+		instances[instanceID] = struct{}{}
+		profiles[p.profileID] = struct{}{}
+	}
+	return instances, profiles
+}
+
+// ForgetPendingSmlu drops the instance once a pod recording it is known.
+func ForgetPendingSmlu(slot, instanceID int) {
+	pendingSmlus.Lock()
+	defer pendingSmlus.Unlock()
+	delete(pendingSmlus.slots[slot], instanceID)
+}
@@ -0,0 +1,47 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestPendingSmlu(t *testing.T) {
+	addPendingSmlu(0, 1, 3)
+	addPendingSmlu(0, 2, 3)
+	addPendingSmlu(1, 1, 4)
+
+	instances, profiles := PendingSmlu(0)
+	assert.Equal(t, map[int]struct{}{1: {}, 2: {}}, instances)
+	assert.Equal(t, map[int]struct{}{3: {}}, profiles)
+
+	ForgetPendingSmlu(0, 1)
+	instances, _ = PendingSmlu(0)
+	assert.Equal(t, map[int]struct{}{2: {}}, instances)
+
+	// instances never recorded by a pod expire
+	origin := pendingSmluTTL
+	defer func() { pendingSmluTTL = origin }()
+	pendingSmluTTL = 0
+	time.Sleep(time.Millisecond)
+	instances, profiles = PendingSmlu(1)
+	assert.Empty(t, instances)
+	assert.Empty(t, profiles)
+	ForgetPendingSmlu(0, 2)
+	ForgetPendingSmlu(3, 1)
+}
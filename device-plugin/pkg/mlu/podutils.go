@@ -149,14 +149,21 @@ func (m *CambriconDevicePlugin) releaseNodeLock() error {
 	return err
 }
 
+// getDynamicSmluCandidatePod always lists pods from the apiserver. A lagging
+// informer cache may still show a pod allocated earlier as unassigned, the
+// smlu would then be created for and annotated on the wrong pod.
 func (m *CambriconDevicePlugin) getDynamicSmluCandidatePod(ctx context.Context) (*v1.Pod, error) {
-	var podCount, containerCount uint
-	var candidatePod v1.Pod
-
 	allPods, err := m.getPendingPodsInNode(ctx)
 	if err != nil {
 		return nil, err
 	}
+	return dynamicSmluCandidatePod(allPods)
+}
+
+func dynamicSmluCandidatePod(allPods []v1.Pod) (*v1.Pod, error) {
+	var podCount, containerCount uint
+	var candidatePod v1.Pod
+
 	log.Debugf("Found %d pending pods", len(allPods))
 
 	for _, pod := range allPods {
@@ -0,0 +1,303 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"fmt"
+	"sort"
+
+	log "github.com/sirupsen/logrus"
+	pluginapi "k8s.io/kubelet/pkg/apis/deviceplugin/v1beta1"
+)
+
+// preferredPolicy chooses the devices of a request within a set of
+// candidates, the NUMA packing in preferNUMA decides which candidates.
+type preferredPolicy struct {
+	// capacity is the largest request the policy can serve from ids.
+	capacity func(ids []string) int
+	pick     func(available, required []string, size int) ([]string, error)
+}
+
+// numaNode is the available devices of one NUMA node, in available order.
+type numaNode struct {
+	id  int
+	ids []string
+}
+
+// preferNUMA keeps a request on a single NUMA node when one can serve it,
+// choosing the node with the least capacity left that still fits (best-fit)
+// so larger nodes stay free for larger requests. Otherwise it spans the
+// fewest nodes, taking the largest first.
+func preferNUMA(available, required []string, size int, numaOf func(id string) int, p preferredPolicy) ([]string, error) {
+	var nodes []*numaNode
+	index := map[int]*numaNode{}
+	for _, id := range available {
+		numa := numaOf(id)
+		n, ok := index[numa]
+		if !ok {
+			n = &numaNode{id: numa}
+			index[numa] = n
+			nodes = append(nodes, n)
+		}
+		n.ids = append(n.ids, id)
+	}
+	if len(nodes) < 2 {
+		return p.pick(available, required, size)
+	}
+	sort.Slice(nodes, func(i, j int) bool { return nodes[i].id < nodes[j].id })
+
+	requiredNodes := map[int]bool{}
+	for _, id := range required {
+		requiredNodes[numaOf(id)] = true
+	}
+	capacity := make([]int, len(nodes))
+	for i, n := range nodes {
+		capacity[i] = p.capacity(n.ids)
+	}
+
+	best := -1
+	for i, n := range nodes {
+		if capacity[i] < size || len(requiredNodes) > 1 || (len(requiredNodes) == 1 && !requiredNodes[n.id]) {
+			continue
+		}
+		if best == -1 || capacity[i] < capacity[best] {
+			best = i
+		}
+	}
+	if best != -1 {
+		log.Debugf("Prefer numa node %d for %d devices", nodes[best].id, size)
+		return p.pick(nodes[best].ids, required, size)
+	}
+
+	// nodes of required devices come first, then the largest ones
+	order := make([]int, len(nodes))
+	for i := range order {
+		order[i] = i
+	}
+	sort.SliceStable(order, func(i, j int) bool {
+		ri, rj := requiredNodes[nodes[order[i]].id], requiredNodes[nodes[order[j]].id]
+		if ri != rj {
+			return ri
+		}
+		return capacity[order[i]] > capacity[order[j]]
+	})
+	var ids []string
+	var total int
+	for _, i := range order {
+		if total >= size && !requiredNodes[nodes[i].id] {
+			break
+		}
+		ids = append(ids, nodes[i].ids...)
+		total += capacity[i]
+	}
+	log.Debugf("No single numa node fits %d devices, prefer %v", size, ids)
+	return p.pick(ids, required, size)
+}
+
+// slotOrderPolicy takes required devices first, then the others in the
+// order they are given.
+func slotOrderPolicy() preferredPolicy {
+	return preferredPolicy{
+		capacity: func(ids []string) int { return len(ids) },
+		pick: func(available, required []string, size int) ([]string, error) {
+			res := append([]string{}, required...)
+			taken := map[string]bool{}
+			for _, id := range required {
+				taken[id] = true
+			}
+			for _, id := range available {
+				if len(res) >= size {
+					break
+				}
+				if !taken[id] {
+					res = append(res, id)
+				}
+			}
+			if len(res) < size {
+				return nil, fmt.Errorf("can not get preferred devices since available is shorter than required, required:%d, available:%d", size, len(res))
+			}
+			return res, nil
+		},
+	}
+}
+
+// envSharePolicy takes one virtual device per card, see preferEnvShare.
+func envSharePolicy(util func(uuid string) int) preferredPolicy {
+	return preferredPolicy{
+		capacity: func(ids []string) int {
+			cards := map[string]bool{}
+			for _, id := range ids {
+				if p, err := parseEnvShareID(id); err == nil {
+					cards[p.uuid] = true
+				}
+			}
+			return len(cards)
+		},
+		pick: func(available, _ []string, size int) ([]string, error) {
+			return preferEnvShare(available, size, util)
+		},
+	}
+}
+
+// mimPolicy places mim instances by their parent card. With pack, the
+// request goes to the fewest cards, preferring the cards of the required
+// instances and then partially used ones so whole cards stay free. With
+// spread, it goes round robin over the cards with the most available
+// instances.
+func (m *CambriconDevicePlugin) mimPolicy() preferredPolicy {
+	// A card is partially used when fewer of its instances are available
+	// than it has in devsInfo. This relies on a plugin serving a single
+	// profile, instances of other profiles would count as used otherwise.
+	total := map[uint]int{}
+	for _, d := range m.devsInfo {
+		total[d.Slot]++
+	}
+	return preferredPolicy{
+		capacity: func(ids []string) int { return len(ids) },
+		pick: func(available, required []string, size int) ([]string, error) {
+			res := append([]string{}, required...)
+			taken := map[string]bool{}
+			seeds := map[uint]bool{}
+			for _, id := range required {
+				taken[id] = true
+				seeds[m.slotOf(id)] = true
+			}
+			type card struct {
+				slot uint
+				ids  []string
+			}
+			var cards []*card
+			index := map[uint]*card{}
+			count := 0
+			for _, id := range available {
+				if taken[id] {
+					continue
+				}
+				slot := m.slotOf(id)
+				c, ok := index[slot]
+				if !ok {
+					c = &card{slot: slot}
+					index[slot] = c
+					cards = append(cards, c)
+				}
+				c.ids = append(c.ids, id)
+				count++
+			}
+			need := size - len(res)
+			if need > count {
+				return nil, fmt.Errorf("can not get preferred devices since available is shorter than required, required:%d, available:%d", size, len(res)+count)
+			}
+			partial := func(c *card) bool { return len(c.ids) < total[c.slot] }
+			seeded := func(c *card) bool { return seeds[c.slot] }
+
+			if m.options.MimAllocationPolicy == mimSpread {
+				sort.SliceStable(cards, func(i, j int) bool { return len(cards[i].ids) > len(cards[j].ids) })
+				for round := 0; need > 0; round++ {
+					for _, c := range cards {
+						if need > 0 && round < len(c.ids) {
+							res = append(res, c.ids[round])
+							need--
+						}
+					}
+				}
+				return res, nil
+			}
+
+			// betterFit orders the cards which can serve the rest of the
+			// request, takeFirst those taken whole when none can.
+			betterFit := func(a, b *card) bool {
+				if seeded(a) != seeded(b) {
+					return seeded(a)
+				}
+				if partial(a) != partial(b) {
+					return partial(a)
+				}
+				return len(a.ids) < len(b.ids)
+			}
+			takeFirst := func(a, b *card) bool {
+				if seeded(a) != seeded(b) {
+					return seeded(a)
+				}
+				if len(a.ids) != len(b.ids) {
+					return len(a.ids) > len(b.ids)
+				}
+				return partial(a) && !partial(b)
+			}
+			for need > 0 {
+				var fit, largest *card
+				for _, c := range cards {
+					if len(c.ids) == 0 {
+						continue
+					}
+					if len(c.ids) >= need && (fit == nil || betterFit(c, fit)) {
+						fit = c
+					}
+					if largest == nil || takeFirst(c, largest) {
+						largest = c
+					}
+				}
+				if fit != nil {
+					return append(res, fit.ids[:need]...), nil
+				}
+				res = append(res, largest.ids...)
+				need -= len(largest.ids)
+				largest.ids = nil
+			}
+			return res, nil
+		},
+	}
+}
+
+func (m *CambriconDevicePlugin) slotOf(id string) uint {
+	if d, ok := m.devsInfo[id]; ok {
+		return d.Slot
+	}
+	return 0
+}
+
+func (m *CambriconDevicePlugin) preferredAllocationAvailable() bool {
+	switch m.options.Mode {
+	case Default, EnvShare, Mim, TopologyAware:
+		return true
+	}
+	return false
+}
+
+// getPreferredNUMADeviceIDs serves the preferred allocation of the modes
+// without MLULink awareness.
+func (m *CambriconDevicePlugin) getPreferredNUMADeviceIDs(req *pluginapi.ContainerPreferredAllocationRequest) ([]string, error) {
+	p := slotOrderPolicy()
+	switch {
+	case m.options.Mode == EnvShare && m.profile != realCounts:
+		p = envSharePolicy(m.utilization.get)
+	case m.options.Mode == Mim && m.profile != realCounts && m.profile != normalMlu:
+		p = m.mimPolicy()
+	}
+	numaOf := func(id string) int {
+		if d, ok := m.devsInfo[id]; ok {
+			return d.Numa
+		}
+		return 0
+	}
+	// devices of a node are then taken in slot order
+	available := append([]string{}, req.AvailableDeviceIDs...)
+	sort.SliceStable(available, func(i, j int) bool {
+		if si, sj := m.slotOf(available[i]), m.slotOf(available[j]); si != sj {
+			return si < sj
+		}
+		return available[i] < available[j]
+	})
+	return preferNUMA(available, req.MustIncludeDeviceIDs, int(req.AllocationSize), numaOf, p)
+}
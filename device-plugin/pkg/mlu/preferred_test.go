@@ -0,0 +1,179 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"context"
+	"fmt"
+	"testing"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	"github.com/stretchr/testify/assert"
+	pluginapi "k8s.io/kubelet/pkg/apis/deviceplugin/v1beta1"
+)
+
+// newNUMAPlugin returns a plugin of mode with 8 cards, 4 on each of two
+// NUMA nodes, and vfs virtual devices per card in env-share mode.
+func newNUMAPlugin(mode pluginMode, vfs int) *CambriconDevicePlugin {
+	devsInfo := map[string]*cndev.Device{}
+	for slot := 0; slot < 8; slot++ {
+		d := &cndev.Device{
+			Numa: slot / 4,
+			Slot: uint(slot),
+			UUID: fmt.Sprintf("MLU-%d", slot),
+		}
+		if mode != EnvShare {
+			devsInfo[d.UUID] = d
+			continue
+		}
+		_, infos := generateFakeDevs(d, vfs, EnvShare)
+		for k, v := range infos {
+			devsInfo[k] = v
+		}
+	}
+	return &CambriconDevicePlugin{devsInfo: devsInfo, options: Options{Mode: mode}}
+}
+
+func TestGetPreferredAllocationNUMA(t *testing.T) {
+	tests := []struct {
+		name      string
+		mode      pluginMode
+		available []string
+		required  []string
+		size      int32
+		expected  []string
+	}{
+		{
+			name:      "best-fit node",
+			mode:      Default,
+			available: []string{"MLU-0", "MLU-1", "MLU-2", "MLU-3", "MLU-5", "MLU-6", "MLU-7"},
+			size:      2,
+			expected:  []string{"MLU-5", "MLU-6"},
+		},
+		{
+			name:      "only the larger node fits",
+			mode:      Default,
+			available: []string{"MLU-7", "MLU-0", "MLU-2", "MLU-1", "MLU-3", "MLU-5", "MLU-6"},
+			size:      4,
+			expected:  []string{"MLU-0", "MLU-1", "MLU-2", "MLU-3"},
+		},
+		{
+			name:      "span largest nodes first",
+			mode:      Default,
+			available: []string{"MLU-0", "MLU-1", "MLU-4", "MLU-5", "MLU-6"},
+			size:      4,
+			expected:  []string{"MLU-4", "MLU-5", "MLU-6", "MLU-0"},
+		},
+		{
+			name:      "stay on the node of required devices",
+			mode:      Mim,
+			available: []string{"MLU-0", "MLU-1", "MLU-2", "MLU-4", "MLU-5", "MLU-6", "MLU-7"},
+			required:  []string{"MLU-1"},
+			size:      2,
+			expected:  []string{"MLU-1", "MLU-0"},
+		},
+		{
+			name:      "one vf per card on one node",
+			mode:      EnvShare,
+			available: []string{"MLU-0-_-1", "MLU-0-_-2", "MLU-1-_-2", "MLU-4-_-1", "MLU-4-_-2", "MLU-5-_-1", "MLU-6-_-1"},
+			size:      2,
+			expected:  []string{"MLU-0-_-1", "MLU-1-_-2"},
+		},
+		{
+			name:      "vfs spread over cards of the fitting node",
+			mode:      EnvShare,
+			available: []string{"MLU-0-_-1", "MLU-0-_-2", "MLU-1-_-2", "MLU-4-_-1", "MLU-4-_-2", "MLU-5-_-1", "MLU-6-_-1"},
+			size:      3,
+			expected:  []string{"MLU-4-_-1", "MLU-5-_-1", "MLU-6-_-1"},
+		},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			m := newNUMAPlugin(tt.mode, 2)
+			resp, err := m.GetPreferredAllocation(context.TODO(), &pluginapi.PreferredAllocationRequest{
+				ContainerRequests: []*pluginapi.ContainerPreferredAllocationRequest{
+					{
+						AvailableDeviceIDs:   tt.available,
+						MustIncludeDeviceIDs: tt.required,
+						AllocationSize:       tt.size,
+					},
+				},
+			})
+			assert.NoError(t, err)
+			assert.Equal(t, tt.expected, resp.ContainerResponses[0].DeviceIDs)
+		})
+	}
+}
+
+func TestPreferredAllocationAvailable(t *testing.T) {
+	for mode, expected := range map[pluginMode]bool{
+		Default:       true,
+		DynamicSmlu:   false,
+		EnvShare:      true,
+		Mim:           true,
+		TopologyAware: true,
+	} {
+		m := &CambriconDevicePlugin{options: Options{Mode: mode}}
+		opts, err := m.GetDevicePluginOptions(context.TODO(), &pluginapi.Empty{})
+		assert.NoError(t, err)
+		assert.Equal(t, expected, opts.GetPreferredAllocationAvailable, mode)
+	}
+}
+
+func TestGetPreferredAllocationMim(t *testing.T) {
+	devsInfo := map[string]*cndev.Device{}
+	for slot := 0; slot < 3; slot++ {
+		for i := 0; i < 4; i++ {
+			id := fmt.Sprintf("MLU-%d-mim-%d", slot, i)
+			devsInfo[id] = &cndev.Device{Slot: uint(slot), UUID: id, Profile: "2m.16gb"}
+		}
+	}
+	// card 0 is free, cards 1 and 2 are partially used
+	available := []string{
+		"MLU-0-mim-0", "MLU-0-mim-1", "MLU-0-mim-2", "MLU-0-mim-3",
+		"MLU-1-mim-1", "MLU-1-mim-3",
+		"MLU-2-mim-0", "MLU-2-mim-1", "MLU-2-mim-2",
+	}
+	tests := []struct {
+		policy   string
+		size     int32
+		required []string
+		expected []string
+	}{
+		{"", 2, nil, []string{"MLU-1-mim-1", "MLU-1-mim-3"}},
+		{mimPack, 3, nil, []string{"MLU-2-mim-0", "MLU-2-mim-1", "MLU-2-mim-2"}},
+		{mimPack, 4, nil, []string{"MLU-0-mim-0", "MLU-0-mim-1", "MLU-0-mim-2", "MLU-0-mim-3"}},
+		{mimPack, 5, nil, []string{"MLU-0-mim-0", "MLU-0-mim-1", "MLU-0-mim-2", "MLU-0-mim-3", "MLU-1-mim-1"}},
+		// the card of a required instance is used first when it fits
+		{mimPack, 3, []string{"MLU-0-mim-0"}, []string{"MLU-0-mim-0", "MLU-0-mim-1", "MLU-0-mim-2"}},
+		{mimPack, 6, []string{"MLU-1-mim-1"}, []string{"MLU-1-mim-1", "MLU-1-mim-3", "MLU-0-mim-0", "MLU-0-mim-1", "MLU-0-mim-2", "MLU-0-mim-3"}},
+		{mimSpread, 3, nil, []string{"MLU-0-mim-0", "MLU-2-mim-0", "MLU-1-mim-1"}},
+		{mimSpread, 5, nil, []string{"MLU-0-mim-0", "MLU-2-mim-0", "MLU-1-mim-1", "MLU-0-mim-1", "MLU-2-mim-1"}},
+	}
+	for _, tt := range tests {
+		m := &CambriconDevicePlugin{
+			devsInfo: devsInfo,
+			options:  Options{Mode: Mim, MimAllocationPolicy: tt.policy},
+			profile:  "2m.16gb",
+		}
+		ids, err := m.getPreferredNUMADeviceIDs(&pluginapi.ContainerPreferredAllocationRequest{
+			AvailableDeviceIDs:   available,
+			MustIncludeDeviceIDs: tt.required,
+			AllocationSize:       tt.size,
+		})
+		assert.NoError(t, err)
+		assert.Equal(t, tt.expected, ids, "policy %q size %d", tt.policy, tt.size)
+	}
+}
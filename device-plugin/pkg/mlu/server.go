@@ -23,7 +23,6 @@ import (
 	"net"
 	"os"
 	"path"
-	"sort"
 	"strconv"
 	"strings"
 	"sync"
@@ -32,11 +31,13 @@ import (
 
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/allocator"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/metrics"
 	log "github.com/sirupsen/logrus"
 	"google.golang.org/grpc"
 	"google.golang.org/grpc/credentials/insecure"
 	metav1 "k8s.io/apimachinery/pkg/apis/meta/v1"
 	"k8s.io/apimachinery/pkg/types"
+	"k8s.io/apimachinery/pkg/util/wait"
 	"k8s.io/client-go/kubernetes"
 	"k8s.io/client-go/rest"
 	pluginapi "k8s.io/kubelet/pkg/apis/deviceplugin/v1beta1"
@@ -53,12 +54,17 @@ type CambriconDevicePlugin struct {
 	nodeHostname string
 	options      Options
 	profile      string
+	resourceName string
 	server       *grpc.Server
 	socket       string
 	stop         chan interface{}
+	utilization  *utilizationSampler
 	sync.RWMutex
 }
 
+// kubeletSocket is where plugins register, tests point it to a fake kubelet.
+var kubeletSocket = pluginapi.KubeletSocket
+
 // Use global variables to synchronize information between goroutines, should always add lock and clean when finished
 var dynamicSmlu map[string]*pluginapi.AllocateResponse
 var profileAndInstance map[string]string
@@ -84,7 +90,7 @@ func NewCambriconDevicePlugin(o Options, profile string, devs []*pluginapi.Devic
 
 func (m *CambriconDevicePlugin) GetDevicePluginOptions(context.Context, *pluginapi.Empty) (*pluginapi.DevicePluginOptions, error) {
 	return &pluginapi.DevicePluginOptions{
-		GetPreferredAllocationAvailable: m.options.Mode == TopologyAware || m.options.Mode == EnvShare,
+		GetPreferredAllocationAvailable: m.preferredAllocationAvailable(),
 	}, nil
 }
 
@@ -100,6 +106,9 @@ func dial(socket string, timeout time.Duration) (*grpc.ClientConn, error) {
 		return dialer.DialContext(ctx, "unix", addr)
 	}), grpc.WithBlock())
 	if err != nil {
+		if errors.Is(err, context.DeadlineExceeded) {
+			metrics.Timeouts.Inc("dial")
+		}
 		return nil, fmt.Errorf("failure connecting to %s: %v", socket, err)
 	}
 	return conn, nil
@@ -107,6 +116,26 @@ func dial(socket string, timeout time.Duration) (*grpc.ClientConn, error) {
 
 // Start starts the gRPC server of the device plugin
 func (m *CambriconDevicePlugin) Start() error {
+	if err := m.serve(); err != nil {
+		return err
+	}
+
+	healthCheck := !m.options.DisableHealthCheck && m.profile != realCounts
+	liveness.serving(m.socket, healthCheck)
+	if healthCheck {
+		go m.healthcheck()
+	}
+
+	if m.options.Mode == EnvShare && m.profile != realCounts {
+		m.utilization = newUtilizationSampler(m.devsInfo)
+		go m.utilization.run(m.stop, utilizationSampleInterval)
+	}
+
+	return nil
+}
+
+// serve listens on a fresh plugin socket and waits for the gRPC server to answer.
+func (m *CambriconDevicePlugin) serve() error {
 	err := m.cleanup()
 	if err != nil {
 		return err
@@ -128,11 +157,6 @@ func (m *CambriconDevicePlugin) Start() error {
 		return err
 	}
 	conn.Close()
-
-	if !m.options.DisableHealthCheck && m.profile != realCounts {
-		go m.healthcheck()
-	}
-
 	return nil
 }
 
@@ -145,6 +169,7 @@ func (m *CambriconDevicePlugin) Stop() error {
 	m.server.Stop()
 	m.server = nil
 	close(m.stop)
+	liveness.stopped(m.socket)
 
 	return m.cleanup()
 }
@@ -163,7 +188,7 @@ func (m *CambriconDevicePlugin) Register(kubeletEndpoint, resourceName string) e
 		Endpoint:     path.Base(m.socket),
 		ResourceName: resourceName,
 		Options: &pluginapi.DevicePluginOptions{
-			GetPreferredAllocationAvailable: m.options.Mode == TopologyAware || m.options.Mode == EnvShare,
+			GetPreferredAllocationAvailable: m.preferredAllocationAvailable(),
 		},
 	}
 
@@ -186,6 +211,10 @@ func (m *CambriconDevicePlugin) ListAndWatch(_ *pluginapi.Empty, s pluginapi.Dev
 		select {
 		case <-m.stop:
 			return nil
+		case <-s.Context().Done():
+			// kubelet went away, a new stream is opened after registering again.
+			log.Printf("ListAndWatch stream via sock %s closed: %v", m.socket, s.Context().Err())
+			return nil
 		case d := <-m.health:
 			for i, dev := range m.devs {
 				if dev.ID == d.ID {
@@ -203,6 +232,8 @@ func (m *CambriconDevicePlugin) ListAndWatch(_ *pluginapi.Empty, s pluginapi.Dev
 }
 
 func (m *CambriconDevicePlugin) PrepareResponse(uuids []string) *pluginapi.ContainerAllocateResponse {
+	defer metrics.PrepareResponseDuration.ObserveSince(time.Now(), m.profile)
+
 	resp := &pluginapi.ContainerAllocateResponse{}
 
 	devPaths := m.uuidToPath(uuids)
@@ -373,6 +404,7 @@ func (m *CambriconDevicePlugin) allocateDynamicSmlu(ctx context.Context) (*plugi
 		return nil, fmt.Errorf("get profile from annotation %v", err)
 	}
 	log.Debugf("Get profile %v from pod %s", pl, pod.Name)
+	defer metrics.DsmluOperationDuration.ObserveSince(time.Now(), "create")
 
 	var profileID int
 	var dsmluInfo cndev.SmluInfo
@@ -382,6 +414,8 @@ func (m *CambriconDevicePlugin) allocateDynamicSmlu(ctx context.Context) (*plugi
 		check(err)
 		memUnit = int(mem) / 100
 	}
+	cndev.SmluLock(uint(pl.Slot)).Lock()
+	defer cndev.SmluLock(uint(pl.Slot)).Unlock()
 	if info, ok := cndev.GetExistProfile(pl, memUnit); ok {
 		if info.Remain < 1 {
 			log.Errorf("Found exist profile %d for device %d but its remain %d is invaild", info.ProfileID, pl.Slot, info.Remain)
@@ -425,6 +459,7 @@ func (m *CambriconDevicePlugin) allocateDynamicSmlu(ctx context.Context) (*plugi
 	}
 
 	log.Debugf("Created profile %d instance %d for pod %s", profileID, mluIntance, pod.Name)
+	addPendingSmlu(pl.Slot, dsmluInfo.InstanceID, profileID)
 
 	uuid, ok := m.GetDeviceUUIDByIndex(uint(pl.Slot))
 	if !ok {
@@ -457,6 +492,7 @@ func (m *CambriconDevicePlugin) allocateDynamicSmlu(ctx context.Context) (*plugi
 // Allocate which return list of devices.
 func (m *CambriconDevicePlugin) Allocate(ctx context.Context, reqs *pluginapi.AllocateRequest) (*pluginapi.AllocateResponse, error) {
 	ta := time.Now()
+	defer metrics.AllocateDuration.ObserveSince(ta, m.profile)
 	log.Debugf("Receive allocate requesets %v in time %s", reqs, ta)
 
 	if m.options.Mode == DynamicSmlu {
@@ -503,7 +539,11 @@ func (m *CambriconDevicePlugin) healthcheck() {
 	ctx, cancel := context.WithCancel(context.Background())
 	health := make(chan *pluginapi.Device)
 
-	go watchUnhealthy(ctx, m.devsInfo, health)
+	interval := healthCheckInterval
+	if m.options.Uevent {
+		interval = ueventHealthCheckInterval
+	}
+	go watchUnhealthy(ctx, m.devsInfo, health, interval, func() { liveness.sweep(m.socket) })
 
 	for {
 		select {
@@ -523,7 +563,7 @@ func (m *CambriconDevicePlugin) Serve() error {
 	}
 
 	if m.options.Mode == TopologyAware {
-		m.allocator = allocator.New(m.options.MLULinkPolicy, m.devsInfo)
+		m.allocator = allocator.New(m.options.MLULinkPolicy, m.devsInfo, m.options.PCIeAffinity)
 		m.clientset = InitClientSet()
 	}
 
@@ -568,7 +608,8 @@ func (m *CambriconDevicePlugin) Serve() error {
 	if m.profile == realCounts {
 		resourceName = "cambricon.com/" + realCounts
 	}
-	if err := m.Register(pluginapi.KubeletSocket, resourceName); err != nil {
+	m.resourceName = resourceName
+	if err := m.Register(kubeletSocket, resourceName); err != nil {
 		m.Stop()
 		return fmt.Errorf("register resource %s err: %v", resourceName, err)
 	}
@@ -576,16 +617,45 @@ func (m *CambriconDevicePlugin) Serve() error {
 	return nil
 }
 
+// Reregister registers the serving plugin with a restarted kubelet. kubelet
+// removes every socket in the device plugin directory when it starts, so
+// the gRPC server is served again on a fresh socket, device state and
+// health check are kept as they are.
+func (m *CambriconDevicePlugin) Reregister(backoff wait.Backoff) error {
+	// Stopping the old server ends its ListAndWatch stream, health updates
+	// wait in m.health for the stream kubelet opens after registering.
+	m.server.Stop()
+	if err := m.serve(); err != nil {
+		return fmt.Errorf("serve on socket %s again: %v", m.socket, err)
+	}
+
+	var lastErr error
+	err := wait.ExponentialBackoff(backoff, func() (bool, error) {
+		if lastErr = m.Register(kubeletSocket, m.resourceName); lastErr != nil {
+			log.Warnf("Register resource %s again err: %v, retrying", m.resourceName, lastErr)
+			return false, nil
+		}
+		return true, nil
+	})
+	if err != nil {
+		return fmt.Errorf("register resource %s again: %v, last err: %v", m.resourceName, err, lastErr)
+	}
+	log.Printf("Registered resource %s again", m.resourceName)
+	return nil
+}
+
 func (m *CambriconDevicePlugin) GetPreferredAllocation(_ context.Context, r *pluginapi.PreferredAllocationRequest) (*pluginapi.PreferredAllocationResponse, error) {
+	defer metrics.GetPreferredAllocationDuration.ObserveSince(time.Now(), m.profile)
+
 	response := &pluginapi.PreferredAllocationResponse{}
 	for _, req := range r.ContainerRequests {
 		var allocated []string
 		var err error
 		switch m.options.Mode {
-		case EnvShare:
-			allocated, err = getPreferredEnvShareDeviceID(req)
+		case Default, EnvShare, Mim:
+			allocated, err = m.getPreferredNUMADeviceIDs(req)
 			if err != nil {
-				log.Errorf("Failed to get preferred allocated devices for env share mode, requests %d, err: %v", req.AllocationSize, err)
+				log.Errorf("Failed to get preferred allocated devices for %s mode, requests %d, err: %v", m.options.Mode, req.AllocationSize, err)
 				return response, err
 			}
 		case TopologyAware:
@@ -676,47 +746,3 @@ func InitClientSet() kubernetes.Interface {
 	}
 	return clientset
 }
-
-func getPreferredEnvShareDeviceID(req *pluginapi.ContainerPreferredAllocationRequest) ([]string, error) {
-	dMap := map[string][]int{}
-	for _, id := range req.AvailableDeviceIDs {
-		ids := strings.Split(id, "-_-")
-		uuid := ids[0]
-		vf, err := strconv.Atoi(ids[len(ids)-1])
-		if err != nil {
-			log.Errorf("Convert value to int, error %v, value %s", err, ids[len(ids)-1])
-			return nil, err
-		}
-		dMap[uuid] = append(dMap[uuid], vf)
-	}
-
-	type envShareDeviceID struct {
-		uuid string
-		vfs  []int
-	}
-	es := []envShareDeviceID{}
-	for k, v := range dMap {
-		sort.Ints(v)
-		es = append(es, envShareDeviceID{
-			uuid: k,
-			vfs:  v,
-		})
-	}
-	sort.Slice(es, func(i int, j int) bool {
-		return len(es[i].vfs) > len(es[j].vfs)
-	})
-
-	if req.AllocationSize == 1 {
-		return []string{fmt.Sprintf("%s-_-%d", es[0].uuid, es[0].vfs[0])}, nil
-	}
-
-	if int(req.AllocationSize) > len(es) {
-		return nil, fmt.Errorf("can not get preferred devices since available is shorter than required, required:%d, available:%d", int(req.AllocationSize), len(es))
-	}
-
-	res := []string{}
-	for i := 0; i < int(req.AllocationSize); i++ {
-		res = append(res, fmt.Sprintf("%s-_-%d", es[i].uuid, es[i].vfs[0]))
-	}
-	return res, nil
-}
@@ -16,13 +16,19 @@ package mlu
 
 import (
 	"context"
+	"net"
+	"os"
+	"path/filepath"
 	"testing"
+	"time"
 
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
 	"github.com/stretchr/testify/assert"
+	"google.golang.org/grpc"
 	v1 "k8s.io/api/core/v1"
 	"k8s.io/apimachinery/pkg/api/resource"
 	metav1 "k8s.io/apimachinery/pkg/apis/meta/v1"
+	"k8s.io/apimachinery/pkg/util/wait"
 	"k8s.io/client-go/kubernetes/fake"
 	pluginapi "k8s.io/kubelet/pkg/apis/deviceplugin/v1beta1"
 )
@@ -162,7 +168,7 @@ func TestGetPreferredEnvShareDeviceID(t *testing.T) {
 	}
 
 	for i, req := range reqs {
-		ids, err := getPreferredEnvShareDeviceID(&req)
+		ids, err := preferEnvShare(req.AvailableDeviceIDs, int(req.AllocationSize), nil)
 		if i != 2 {
 			assert.NoError(t, err)
 			assert.Equal(t, ids, expects[i])
@@ -454,3 +460,54 @@ func TestCambriconDevicePluginAllocateDsmlu(t *testing.T) {
 		assert.Equal(t, pod.Annotations[DsmluProfileAndInstance], "0_256_0_1")
 	})
 }
+
+// fakeKubelet records the register requests it receives.
+type fakeKubelet struct {
+	requests chan *pluginapi.RegisterRequest
+}
+
+func (k *fakeKubelet) Register(_ context.Context, r *pluginapi.RegisterRequest) (*pluginapi.Empty, error) {
+	k.requests <- r
+	return &pluginapi.Empty{}, nil
+}
+
+func TestCambriconDevicePluginReregister(t *testing.T) {
+	dir := t.TempDir()
+	kubelet := &fakeKubelet{requests: make(chan *pluginapi.RegisterRequest, 1)}
+	lis, err := net.Listen("unix", filepath.Join(dir, "kubelet.sock"))
+	assert.NoError(t, err)
+	server := grpc.NewServer()
+	pluginapi.RegisterRegistrationServer(server, kubelet)
+	go server.Serve(lis)
+	defer server.Stop()
+
+	origin := kubeletSocket
+	kubeletSocket = filepath.Join(dir, "kubelet.sock")
+	defer func() { kubeletSocket = origin }()
+
+	devs := []*pluginapi.Device{{ID: "MLU-0", Health: pluginapi.Healthy}}
+	devsInfo := map[string]*cndev.Device{"MLU-0": {Slot: 0, UUID: "MLU-0"}}
+	m := NewCambriconDevicePlugin(Options{Mode: Default, DisableHealthCheck: true}, normalMlu, devs, devsInfo)
+	m.socket = filepath.Join(dir, "cambricon.sock")
+	m.resourceName = "cambricon.com/mlu"
+	assert.NoError(t, m.Start())
+	defer m.Stop()
+
+	// kubelet removes all sockets in the device plugin directory on restart
+	assert.NoError(t, os.Remove(m.socket))
+	assert.NoError(t, m.Reregister(wait.Backoff{Duration: 10 * time.Millisecond, Steps: 3}))
+
+	r := <-kubelet.requests
+	assert.Equal(t, "cambricon.sock", r.Endpoint)
+	assert.Equal(t, "cambricon.com/mlu", r.ResourceName)
+
+	conn, err := dial(m.socket, time.Second)
+	assert.NoError(t, err)
+	defer conn.Close()
+	stream, err := pluginapi.NewDevicePluginClient(conn).ListAndWatch(context.Background(), &pluginapi.Empty{})
+	assert.NoError(t, err)
+	resp, err := stream.Recv()
+	assert.NoError(t, err)
+	assert.Len(t, resp.Devices, 1)
+	assert.Equal(t, "MLU-0", resp.Devices[0].ID)
+}
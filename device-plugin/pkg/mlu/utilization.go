@@ -0,0 +1,96 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package mlu
+
+import (
+	"sync"
+	"time"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	log "github.com/sirupsen/logrus"
+)
+
+// utilizationSampler keeps the latest core utilization of the cards of an
+// env-share plugin, so preferred allocation never waits for the driver.
+type utilizationSampler struct {
+	sync.RWMutex
+	// slots maps card uuids to slots, it is not changed after creation.
+	slots map[string]uint
+	util  map[string]int
+}
+
+func newUtilizationSampler(devsInfo map[string]*cndev.Device) *utilizationSampler {
+	slots := map[string]uint{}
+	for id, d := range devsInfo {
+		p, err := parseEnvShareID(id)
+		if err != nil {
+			continue
+		}
+		slots[p.uuid] = d.Slot
+	}
+	return &utilizationSampler{slots: slots, util: map[string]int{}}
+}
+
+// sample reads the utilization of every card and returns how many were
+// read, cards that fail are treated as idle until the next sample.
+func (s *utilizationSampler) sample() (int, error) {
+	util := make(map[string]int, len(s.slots))
+	var lastErr error
+	for uuid, slot := range s.slots {
+		u, err := cndev.GetDeviceUtilization(slot)
+		if err != nil {
+			lastErr = err
+			continue
+		}
+		util[uuid] = u
+	}
+	s.Lock()
+	s.util = util
+	s.Unlock()
+	return len(util), lastErr
+}
+
+// run samples every interval until stop is closed. It gives up when the
+// driver can't report utilization at all.
+func (s *utilizationSampler) run(stop <-chan interface{}, interval time.Duration) {
+	sampled := false
+	for {
+		n, err := s.sample()
+		if err != nil {
+			if n == 0 && !sampled {
+				log.Warnf("Failed to get mlu utilization, env-share allocation ignores load: %v", err)
+				return
+			}
+			log.Debugf("Failed to get utilization of some mlus: %v", err)
+		}
+		sampled = sampled || n > 0
+
+		select {
+		case <-stop:
+			return
+		case <-time.After(interval):
+		}
+	}
+}
+
+// get returns the last sampled utilization of the card, 0 if unknown.
+func (s *utilizationSampler) get(uuid string) int {
+	if s == nil {
+		return 0
+	}
+	s.RLock()
+	defer s.RUnlock()
+	return s.util[uuid]
+}
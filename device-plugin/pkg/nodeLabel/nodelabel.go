@@ -11,13 +11,13 @@ import (
 	"time"
 
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/informer"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/mlu"
 	"github.com/pkg/errors"
 	log "github.com/sirupsen/logrus"
 	corev1 "k8s.io/api/core/v1"
 	metav1 "k8s.io/apimachinery/pkg/apis/meta/v1"
 	"k8s.io/apimachinery/pkg/util/wait"
-	"k8s.io/client-go/informers"
 	"k8s.io/client-go/kubernetes"
 	"k8s.io/client-go/tools/cache"
 	"k8s.io/client-go/util/retry"
@@ -30,16 +30,22 @@ const (
 	modelLabel         = "Model"
 
 	checkInterval = 30 * time.Second
-	resyncPeriod  = 30 * time.Minute
 )
 
+var invalidLabelValueChars = regexp.MustCompile(`[^a-zA-Z0-9_\.-]+`)
+
 type NodeLabel struct {
-	cpuType       string
-	k8sClient     kubernetes.Interface
-	nodeCache     *corev1.Node
-	nodeCacheLock sync.RWMutex
-	nodeName      string
-	oneShot       bool
+	cpuType string
+	// hardwareLabels caches the model and versions, which only change
+	// with a driver reload.
+	hardwareLabels     map[string]string
+	hardwareLabelsLock sync.Mutex
+	informers          *informer.Node
+	k8sClient          kubernetes.Interface
+	nodeCache          *corev1.Node
+	nodeCacheLock      sync.RWMutex
+	nodeName           string
+	oneShot            bool
 }
 
 func NewNodeLabel(o mlu.Options) *NodeLabel {
@@ -86,38 +92,29 @@ func (nl *NodeLabel) Run(ctx context.Context) {
 func (nl *NodeLabel) initNodeInformer(ctx context.Context) {
 	log.Debug("Initializing node informer")
 
-	factory := informers.NewSharedInformerFactory(nl.k8sClient, resyncPeriod)
-	nodeInformer := factory.Core().V1().Nodes().Informer()
-
-	nodeInformer.AddEventHandler(cache.FilteringResourceEventHandler{
-		FilterFunc: func(obj interface{}) bool {
-			node := obj.(*corev1.Node)
-			return node.Name == nl.nodeName
+	if nl.informers == nil {
+		nl.informers = informer.ForNode(nl.k8sClient, nl.nodeName)
+	}
+	// the informer only watches this node, the cache holds a single object
+	nodeInformer := nl.informers.Nodes()
+	if _, err := nodeInformer.AddEventHandler(cache.ResourceEventHandlerFuncs{
+		AddFunc: func(obj interface{}) {
+			nl.updateNodeCache(obj.(*corev1.Node))
 		},
-		Handler: cache.ResourceEventHandlerFuncs{
-			AddFunc: func(obj interface{}) {
-				nl.updateNodeCache(obj.(*corev1.Node))
-			},
-			UpdateFunc: func(oldObj, newObj interface{}) {
-				oldNode := oldObj.(*corev1.Node)
-				newNode := newObj.(*corev1.Node)
-				if reflect.DeepEqual(oldNode.Labels, newNode.Labels) {
-					return
-				}
-				log.Info("Detects node labels changed, should refresh cache")
-				log.Debugf("Old labels: %v, New labels: %v", oldNode.Labels, newNode.Labels)
-				nl.updateNodeCache(newNode)
-			},
+		UpdateFunc: func(oldObj, newObj interface{}) {
+			oldNode := oldObj.(*corev1.Node)
+			newNode := newObj.(*corev1.Node)
+			if reflect.DeepEqual(oldNode.Labels, newNode.Labels) {
+				return
+			}
+			log.Info("Detects node labels changed, should refresh cache")
+			log.Debugf("Old labels: %v, New labels: %v", oldNode.Labels, newNode.Labels)
+			nl.updateNodeCache(newNode)
 		},
-	})
-
-	stopCh := make(chan struct{})
-	go func() {
-		<-ctx.Done()
-		close(stopCh)
-	}()
-
-	go nodeInformer.Run(stopCh)
+	}); err != nil {
+		log.Errorf("Failed to watch node %s: %v", nl.nodeName, err)
+		return
+	}
 
 	if err := wait.PollUntilContextCancel(ctx, 2*time.Second, true,
 		func(context.Context) (bool, error) {
@@ -240,27 +237,57 @@ func (nl *NodeLabel) updateNodeLabels(labels map[string]string) error {
 func (nl *NodeLabel) getActualLabels() map[string]string {
 	log.Debug("Start to get actual labels")
 
-	labels := make(map[string]string)
+	nl.hardwareLabelsLock.Lock()
+	hardware := nl.hardwareLabels
+	if hardware == nil {
+		var complete bool
+		hardware, complete = getHardwareLabels()
+		if complete {
+			nl.hardwareLabels = hardware
+		}
+	}
+	nl.hardwareLabelsLock.Unlock()
 
-	if model := cndev.GetDeviceModel(0); model != "" {
-		labels[modelLabel] = model
+	labels := make(map[string]string, len(hardware)+1)
+	for k, v := range hardware {
+		labels[k] = v
 	}
 
 	if nl.cpuType != "" {
 		labels[cpuTypeLabel] = nl.cpuType
 	}
 
+	log.Debugf("Actual labels are: %v", labels)
+
+	return labels
+}
+
+// InvalidateHardwareLabels makes the next check query the driver again, it
+// must be called when the driver is reloaded.
+func (nl *NodeLabel) InvalidateHardwareLabels() {
+	nl.hardwareLabelsLock.Lock()
+	defer nl.hardwareLabelsLock.Unlock()
+	nl.hardwareLabels = nil
+}
+
+// getHardwareLabels queries the driver, complete is false when a label is
+// missing so that the query is retried by the next check.
+func getHardwareLabels() (labels map[string]string, complete bool) {
+	labels = make(map[string]string)
+
+	model := cndev.GetDeviceModel(0)
+	if model != "" {
+		labels[modelLabel] = model
+	}
+
 	mcuMajor, mcuMinor, mcuBuild, driverMajor, driverMinor, driverBuild, err := cndev.GetDeviceVersion(0)
 	if err != nil {
 		log.Error(errors.Wrapf(err, "GetDeviceVersion for slot %d", 0))
-		return labels
+		return labels, false
 	}
 	labels[mcuVersionLabel] = fmt.Sprintf("v%d.%d.%d", mcuMajor, mcuMinor, mcuBuild)
 	labels[driverVersionLabel] = fmt.Sprintf("v%d.%d.%d", driverMajor, driverMinor, driverBuild)
-
-	log.Debugf("Actual labels are: %v", labels)
-
-	return labels
+	return labels, model != ""
 }
 
 func getPhysicalCPUType() string {
@@ -282,8 +309,7 @@ func getPhysicalCPUType() string {
 }
 
 func sanitizeLabelValue(value string) string {
-	reg := regexp.MustCompile(`[^a-zA-Z0-9_\.-]+`)
-	sanitized := reg.ReplaceAllString(value, "_")
+	sanitized := invalidLabelValueChars.ReplaceAllString(value, "_")
 	sanitized = strings.Trim(sanitized, "-_.")
 	return sanitized
 }
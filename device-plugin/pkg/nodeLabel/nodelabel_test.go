@@ -6,11 +6,13 @@ import (
 	"testing"
 
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/informer"
 	"github.com/agiledragon/gomonkey/v2"
 	"github.com/pkg/errors"
 	"github.com/stretchr/testify/assert"
 	corev1 "k8s.io/api/core/v1"
 	metav1 "k8s.io/apimachinery/pkg/apis/meta/v1"
+	"k8s.io/apimachinery/pkg/fields"
 	"k8s.io/apimachinery/pkg/runtime"
 	"k8s.io/client-go/kubernetes/fake"
 	k8stesting "k8s.io/client-go/testing"
@@ -35,6 +37,27 @@ func TestGetActualLabels(t *testing.T) {
 	assert.Equal(t, "Intel Xeon", labels[cpuTypeLabel])
 }
 
+func TestGetActualLabelsCachesHardware(t *testing.T) {
+	var queries int
+	stub := gomonkey.ApplyFunc(cndev.GetDeviceModel, func(uint) string {
+		return "MLU370-X8"
+	})
+	defer stub.Reset()
+	stub.ApplyFunc(cndev.GetDeviceVersion, func(uint) (uint, uint, uint, uint, uint, uint, error) {
+		queries++
+		return 1, 2, 3, 4, 5, uint(queries), nil
+	})
+
+	nl := &NodeLabel{}
+	assert.Equal(t, "v4.5.1", nl.getActualLabels()[driverVersionLabel])
+	assert.Equal(t, "v4.5.1", nl.getActualLabels()[driverVersionLabel])
+	assert.Equal(t, 1, queries)
+
+	nl.InvalidateHardwareLabels()
+	assert.Equal(t, "v4.5.2", nl.getActualLabels()[driverVersionLabel])
+	assert.Equal(t, 2, queries)
+}
+
 func TestGetActualLabels_HardwareError(t *testing.T) {
 	stub := gomonkey.ApplyFunc(cndev.GetDeviceModel, func(uint) string {
 		return "MLU370-X8"
@@ -156,3 +179,46 @@ func TestUpdateNodeLabels(t *testing.T) {
 	assert.Equal(t, "v1.2.3", updatedNode.Labels[driverVersionLabel])
 	assert.Equal(t, "Intel_R_Xeon_R_Gold_5118_CPU_2.30GHz", updatedNode.Labels[cpuTypeLabel])
 }
+
+func TestNodeInformerCachesOnlyOwnNode(t *testing.T) {
+	stub := gomonkey.ApplyFunc(cndev.GetDeviceModel, func(uint) string {
+		return "MLU370-X8"
+	})
+	defer stub.Reset()
+	stub.ApplyFunc(cndev.GetDeviceVersion, func(uint) (uint, uint, uint, uint, uint, uint, error) {
+		return 1, 2, 3, 4, 5, 6, nil
+	})
+
+	var nodes []runtime.Object
+	for _, name := range []string{"node-0", "test-node", "node-2", "node-3"} {
+		nodes = append(nodes, &corev1.Node{ObjectMeta: metav1.ObjectMeta{Name: name}})
+	}
+	fakeClient := fake.NewSimpleClientset(nodes...)
+	// the fake clientset ignores field selectors, apply them like the apiserver does
+	fakeClient.PrependReactor("list", "nodes", func(action k8stesting.Action) (bool, runtime.Object, error) {
+		selector := action.(k8stesting.ListAction).GetListRestrictions().Fields
+		list := &corev1.NodeList{}
+		for _, obj := range nodes {
+			node := obj.(*corev1.Node)
+			if selector.Matches(fields.Set{"metadata.name": node.Name}) {
+				list.Items = append(list.Items, *node)
+			}
+		}
+		return true, list, nil
+	})
+
+	informers := informer.New(fakeClient, "test-node")
+	defer informers.Stop()
+	nl := &NodeLabel{
+		informers: informers,
+		k8sClient: fakeClient,
+		nodeName:  "test-node",
+	}
+	ctx, cancel := context.WithCancel(context.Background())
+	defer cancel()
+	nl.initNodeInformer(ctx)
+
+	cached := informers.Nodes().GetStore().List()
+	assert.Len(t, cached, 1)
+	assert.Equal(t, "test-node", cached[0].(*corev1.Node).Name)
+}
@@ -0,0 +1,176 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package topology
+
+import (
+	"bytes"
+	"encoding/json"
+	"fmt"
+	"os"
+	"path/filepath"
+	"strings"
+	"sync"
+
+	"github.com/fsnotify/fsnotify"
+	log "github.com/sirupsen/logrus"
+	pluginapi "k8s.io/kubelet/pkg/apis/deviceplugin/v1beta1"
+)
+
+var kubeletCheckpoint = filepath.Join(pluginapi.DevicePluginPath, "kubelet_internal_checkpoint")
+
+// deviceMask has bit i set for the mlu in slot i.
+type deviceMask uint64
+
+const maxMaskSlots = 64
+
+func (m deviceMask) has(slot uint) bool {
+	return slot < maxMaskSlots && m&(1<<slot) != 0
+}
+
+type checkpointEntry struct {
+	PodUID       string
+	ResourceName string
+	// DeviceIDs is a map of numa node to IDs since kubelet 1.20, and a
+	// plain list of IDs before.
+	DeviceIDs json.RawMessage
+}
+
+type checkpointFile struct {
+	Data struct {
+		PodDeviceEntries []checkpointEntry
+	}
+}
+
+// checkpoint tracks the mlus allocated to each pod in the kubelet device
+// manager checkpoint. The file is reread when the kubelet rewrites it,
+// entries of other resources are skipped without decoding their devices.
+type checkpoint struct {
+	sync.Mutex
+	path  string
+	slots map[string]uint
+
+	data []byte
+	pods map[string]deviceMask
+}
+
+func newCheckpoint(path string, slots map[string]uint) *checkpoint {
+	return &checkpoint{path: path, slots: slots, pods: map[string]deviceMask{}}
+}
+
+// load rereads the checkpoint, changed is false when its content is the
+// same as last time.
+func (c *checkpoint) load() (changed bool, err error) {
+	data, err := os.ReadFile(c.path)
+	if err != nil {
+		return false, err
+	}
+
+	c.Lock()
+	defer c.Unlock()
+	if bytes.Equal(data, c.data) {
+		return false, nil
+	}
+	var f checkpointFile
+	if err := json.Unmarshal(data, &f); err != nil {
+		return false, fmt.Errorf("decode checkpoint %s: %v", c.path, err)
+	}
+	pods := map[string]deviceMask{}
+	for _, entry := range f.Data.PodDeviceEntries {
+		if !strings.HasPrefix(entry.ResourceName, mluResourcePrefix) {
+			continue
+		}
+		ids, err := checkpointDeviceIDs(entry.DeviceIDs)
+		if err != nil {
+			return false, fmt.Errorf("decode devices of pod %s: %v", entry.PodUID, err)
+		}
+		for _, id := range ids {
+			slot, ok := c.slots[strings.TrimLeft(id, uuidPrefix)]
+			if !ok || slot >= maxMaskSlots {
+				continue
+			}
+			pods[entry.PodUID] |= 1 << slot
+		}
+	}
+	c.data = data
+	c.pods = pods
+	return true, nil
+}
+
+func checkpointDeviceIDs(raw json.RawMessage) ([]string, error) {
+	var byNuma map[string][]string
+	if err := json.Unmarshal(raw, &byNuma); err == nil {
+		var ids []string
+		for _, numaIDs := range byNuma {
+			ids = append(ids, numaIDs...)
+		}
+		return ids, nil
+	}
+	var ids []string
+	err := json.Unmarshal(raw, &ids)
+	return ids, err
+}
+
+// inUse returns the mlus allocated to pods for which active is true. The
+// kubelet only drops entries of terminated pods on the next allocation, so
+// the caller filters them out.
+func (c *checkpoint) inUse(active func(uid string) bool) deviceMask {
+	c.Lock()
+	defer c.Unlock()
+	var mask deviceMask
+	for uid, m := range c.pods {
+		if active == nil || active(uid) {
+			mask |= m
+		}
+	}
+	return mask
+}
+
+// watch calls onChange whenever the kubelet rewrites the checkpoint with a
+// different content, until stopCh is closed.
+func (c *checkpoint) watch(stopCh <-chan struct{}, onChange func()) error {
+	watcher, err := fsnotify.NewWatcher()
+	if err != nil {
+		return err
+	}
+	// the kubelet writes a temporary file and renames it, watch the directory
+	if err := watcher.Add(filepath.Dir(c.path)); err != nil {
+		watcher.Close()
+		return err
+	}
+	go func() {
+		defer watcher.Close()
+		for {
+			select {
+			case <-stopCh:
+				return
+			case event := <-watcher.Events:
+				if event.Name != c.path || event.Op&(fsnotify.Create|fsnotify.Write) == 0 {
+					continue
+				}
+				changed, err := c.load()
+				if err != nil {
+					log.Warnf("Failed to load kubelet checkpoint: %v", err)
+					continue
+				}
+				if changed {
+					onChange()
+				}
+			case err := <-watcher.Errors:
+				log.Warnf("Kubelet checkpoint watcher err: %v", err)
+			}
+		}
+	}()
+	return nil
+}
@@ -0,0 +1,76 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package topology
+
+import (
+	"os"
+	"path/filepath"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+const checkpointV120 = `{"Data":{"PodDeviceEntries":[
+{"PodUID":"pod1","ContainerName":"c","ResourceName":"cambricon.com/mlu","DeviceIDs":{"0":["MLU-a"],"1":["MLU-c"]},"AllocResp":"Cg=="},
+{"PodUID":"pod2","ContainerName":"c","ResourceName":"cambricon.com/mlu","DeviceIDs":{"-1":["MLU-b"]},"AllocResp":"Cg=="},
+{"PodUID":"pod3","ContainerName":"c","ResourceName":"nvidia.com/gpu","DeviceIDs":{"0":["GPU-0"]},"AllocResp":"Cg=="}],
+"RegisteredDevices":{"cambricon.com/mlu":["MLU-a","MLU-b","MLU-c","MLU-d"]}},"Checksum":1}`
+
+const checkpointV119 = `{"Data":{"PodDeviceEntries":[
+{"PodUID":"pod1","ContainerName":"c","ResourceName":"cambricon.com/mlu","DeviceIDs":["MLU-d"],"AllocResp":"Cg=="}],
+"RegisteredDevices":{}},"Checksum":1}`
+
+func TestCheckpoint(t *testing.T) {
+	path := filepath.Join(t.TempDir(), "kubelet_internal_checkpoint")
+	c := newCheckpoint(path, map[string]uint{"a": 0, "b": 1, "c": 2, "d": 3})
+
+	assert.NoError(t, os.WriteFile(path, []byte(checkpointV120), 0644))
+	changed, err := c.load()
+	assert.NoError(t, err)
+	assert.True(t, changed)
+	assert.Equal(t, deviceMask(0b0111), c.inUse(nil))
+	assert.Equal(t, deviceMask(0b0101), c.inUse(func(uid string) bool { return uid == "pod1" }))
+
+	changed, err = c.load()
+	assert.NoError(t, err)
+	assert.False(t, changed)
+
+	assert.NoError(t, os.WriteFile(path, []byte(checkpointV119), 0644))
+	changed, err = c.load()
+	assert.NoError(t, err)
+	assert.True(t, changed)
+	assert.Equal(t, deviceMask(0b1000), c.inUse(nil))
+}
+
+func TestCheckpointWatch(t *testing.T) {
+	path := filepath.Join(t.TempDir(), "kubelet_internal_checkpoint")
+	c := newCheckpoint(path, map[string]uint{"a": 0, "b": 1, "c": 2, "d": 3})
+	stopCh := make(chan struct{})
+	defer close(stopCh)
+	changes := make(chan struct{}, 1)
+	assert.NoError(t, c.watch(stopCh, func() { changes <- struct{}{} }))
+
+	// written like the kubelet does, to a temporary file renamed over the checkpoint
+	tmp := path + ".tmp"
+	assert.NoError(t, os.WriteFile(tmp, []byte(checkpointV119), 0644))
+	assert.NoError(t, os.Rename(tmp, path))
+	select {
+	case <-changes:
+	case <-time.After(5 * time.Second):
+		t.Fatal("checkpoint change not noticed")
+	}
+	assert.Equal(t, deviceMask(0b1000), c.inUse(nil))
+}
@@ -0,0 +1,193 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package topology
+
+import (
+	"context"
+	"fmt"
+	"net"
+	"strings"
+	"sync"
+	"time"
+
+	log "github.com/sirupsen/logrus"
+	"google.golang.org/grpc"
+	"google.golang.org/grpc/credentials/insecure"
+	podresourcesapi "k8s.io/kubelet/pkg/apis/podresources/v1"
+)
+
+const mluResourcePrefix = "cambricon.com/mlu"
+
+type podKey struct {
+	namespace string
+	name      string
+}
+
+// podResources keeps the mlu devices of every pod on the node, as reported
+// by the kubelet pod resources v1 API over a long lived connection.
+//
+// The API has no watch, instead pods changed since the last sync are passed
+// in by the caller. They are fetched one by one with Get, deleted pods are
+// dropped without any call. A full List is only done on the first sync,
+// after an error, or when the kubelet does not serve Get, which is behind
+// the KubeletPodResourcesGet feature gate.
+type podResources struct {
+	sync.Mutex
+	socket  string
+	timeout time.Duration
+	maxSize int
+
+	conn   *grpc.ClientConn
+	client podresourcesapi.PodResourcesListerClient
+
+	devices   map[podKey][]string
+	synced    bool
+	getFailed bool
+}
+
+func newPodResources(socket string, timeout time.Duration, maxSize int) *podResources {
+	return &podResources{
+		socket:  socket,
+		timeout: timeout,
+		maxSize: maxSize,
+		devices: map[podKey][]string{},
+	}
+}
+
+func (p *podResources) connect() (podresourcesapi.PodResourcesListerClient, error) {
+	if p.client != nil {
+		return p.client, nil
+	}
+	dialer := func(ctx context.Context, address string) (net.Conn, error) {
+		return (&net.Dialer{Timeout: p.timeout}).DialContext(ctx, "unix", address)
+	}
+	// not blocking, the connection is established by the first call and
+	// reestablished by grpc when the kubelet restarts.
+	conn, err := grpc.Dial(p.socket,
+		grpc.WithTransportCredentials(insecure.NewCredentials()),
+		grpc.WithDefaultCallOptions(grpc.MaxCallRecvMsgSize(p.maxSize)),
+		grpc.WithContextDialer(dialer),
+	)
+	if err != nil {
+		return nil, fmt.Errorf("failure connecting to %s: %v", p.socket, err)
+	}
+	p.conn = conn
+	p.client = podresourcesapi.NewPodResourcesListerClient(conn)
+	return p.client, nil
+}
+
+func (p *podResources) close() {
+	if p.conn != nil {
+		p.conn.Close()
+	}
+	p.conn = nil
+	p.client = nil
+}
+
+// resync makes the next inUse list all pods again.
+func (p *podResources) resync() {
+	p.Lock()
+	defer p.Unlock()
+	p.synced = false
+}
+
+// inUse applies the changed pods, true for deleted ones, and returns the
+// mlu device IDs in use on the node.
+func (p *podResources) inUse(changed map[podKey]bool) ([]string, error) {
+	p.Lock()
+	defer p.Unlock()
+
+	if err := p.sync(changed); err != nil {
+		p.synced = false
+		p.close()
+		return nil, err
+	}
+	var ids []string
+	for _, devices := range p.devices {
+		ids = append(ids, devices...)
+	}
+	log.Debugf("deviceIDs: %#v", ids)
+	return ids, nil
+}
+
+func (p *podResources) sync(changed map[podKey]bool) error {
+	client, err := p.connect()
+	if err != nil {
+		return err
+	}
+	if !p.synced || p.getFailed {
+		return p.list(client)
+	}
+	for key, deleted := range changed {
+		if deleted {
+			delete(p.devices, key)
+			continue
+		}
+		if err := p.get(client, key); err != nil {
+			log.Debugf("Failed to get resources of pod %s/%s, list all pods instead: %v", key.namespace, key.name, err)
+			if strings.Contains(err.Error(), "disabled") {
+				p.getFailed = true
+			}
+			return p.list(client)
+		}
+	}
+	return nil
+}
+
+func (p *podResources) list(client podresourcesapi.PodResourcesListerClient) error {
+	ctx, cancel := context.WithTimeout(context.Background(), p.timeout)
+	defer cancel()
+	resp, err := client.List(ctx, &podresourcesapi.ListPodResourcesRequest{})
+	if err != nil {
+		return fmt.Errorf("failure getting pod resources %v", err)
+	}
+	p.devices = map[podKey][]string{}
+	for _, pod := range resp.GetPodResources() {
+		p.add(pod)
+	}
+	p.synced = true
+	return nil
+}
+
+func (p *podResources) get(client podresourcesapi.PodResourcesListerClient, key podKey) error {
+	ctx, cancel := context.WithTimeout(context.Background(), p.timeout)
+	defer cancel()
+	resp, err := client.Get(ctx, &podresourcesapi.GetPodResourcesRequest{
+		PodName:      key.name,
+		PodNamespace: key.namespace,
+	})
+	if err != nil {
+		return err
+	}
+	delete(p.devices, key)
+	p.add(resp.GetPodResources())
+	return nil
+}
+
+func (p *podResources) add(pod *podresourcesapi.PodResources) {
+	var ids []string
+	for _, container := range pod.GetContainers() {
+		for _, device := range container.GetDevices() {
+			if !strings.HasPrefix(device.GetResourceName(), mluResourcePrefix) {
+				continue
+			}
+			ids = append(ids, device.GetDeviceIds()...)
+		}
+	}
+	if len(ids) == 0 {
+		return
+	}
+	p.devices[podKey{namespace: pod.GetNamespace(), name: pod.GetName()}] = ids
+}
@@ -0,0 +1,140 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package topology
+
+import (
+	"context"
+	"fmt"
+	"net"
+	"path/filepath"
+	"sync"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+	"google.golang.org/grpc"
+	podresourcesapi "k8s.io/kubelet/pkg/apis/podresources/v1"
+)
+
+type fakePodResourcesServer struct {
+	sync.Mutex
+	pods       map[string]*podresourcesapi.PodResources
+	getEnabled bool
+	lists      int
+	gets       int
+}
+
+func (s *fakePodResourcesServer) List(context.Context, *podresourcesapi.ListPodResourcesRequest) (*podresourcesapi.ListPodResourcesResponse, error) {
+	s.Lock()
+	defer s.Unlock()
+	s.lists++
+	resp := &podresourcesapi.ListPodResourcesResponse{}
+	for _, pod := range s.pods {
+		resp.PodResources = append(resp.PodResources, pod)
+	}
+	return resp, nil
+}
+
+func (s *fakePodResourcesServer) GetAllocatableResources(context.Context, *podresourcesapi.AllocatableResourcesRequest) (*podresourcesapi.AllocatableResourcesResponse, error) {
+	return &podresourcesapi.AllocatableResourcesResponse{}, nil
+}
+
+func (s *fakePodResourcesServer) Get(_ context.Context, req *podresourcesapi.GetPodResourcesRequest) (*podresourcesapi.GetPodResourcesResponse, error) {
+	s.Lock()
+	defer s.Unlock()
+	if !s.getEnabled {
+		return nil, fmt.Errorf("PodResources API Get method disabled")
+	}
+	s.gets++
+	pod, ok := s.pods[req.PodName]
+	if !ok {
+		return nil, fmt.Errorf("pod %s not found", req.PodName)
+	}
+	return &podresourcesapi.GetPodResourcesResponse{PodResources: pod}, nil
+}
+
+func (s *fakePodResourcesServer) setPod(name, resource string, ids ...string) {
+	s.Lock()
+	defer s.Unlock()
+	s.pods[name] = &podresourcesapi.PodResources{
+		Name:      name,
+		Namespace: "default",
+		Containers: []*podresourcesapi.ContainerResources{{
+			Devices: []*podresourcesapi.ContainerDevices{{ResourceName: resource, DeviceIds: ids}},
+		}},
+	}
+}
+
+func startFakePodResources(t *testing.T, getEnabled bool) (*fakePodResourcesServer, string) {
+	socket := filepath.Join(t.TempDir(), "kubelet.sock")
+	lis, err := net.Listen("unix", socket)
+	if err != nil {
+		t.Fatal(err)
+	}
+	fake := &fakePodResourcesServer{pods: map[string]*podresourcesapi.PodResources{}, getEnabled: getEnabled}
+	server := grpc.NewServer()
+	podresourcesapi.RegisterPodResourcesListerServer(server, fake)
+	go server.Serve(lis)
+	t.Cleanup(server.Stop)
+	return fake, socket
+}
+
+func TestPodResources(t *testing.T) {
+	fake, socket := startFakePodResources(t, true)
+	fake.setPod("pod1", "cambricon.com/mlu", "MLU-a", "MLU-b")
+	fake.setPod("other", "nvidia.com/gpu", "GPU-0")
+
+	p := newPodResources(socket, time.Second, maxSize)
+	defer p.close()
+	ids, err := p.inUse(nil)
+	assert.NoError(t, err)
+	assert.ElementsMatch(t, []string{"MLU-a", "MLU-b"}, ids)
+
+	// changes are fetched pod by pod, deleted pods cost no call
+	fake.setPod("pod2", "cambricon.com/mlu", "MLU-c")
+	ids, err = p.inUse(map[podKey]bool{
+		{namespace: "default", name: "pod1"}: true,
+		{namespace: "default", name: "pod2"}: false,
+	})
+	assert.NoError(t, err)
+	assert.ElementsMatch(t, []string{"MLU-c"}, ids)
+	assert.Equal(t, 1, fake.lists)
+	assert.Equal(t, 1, fake.gets)
+
+	// a pod unknown to the kubelet falls back to a full list
+	ids, err = p.inUse(map[podKey]bool{{namespace: "default", name: "pod3"}: false})
+	assert.NoError(t, err)
+	assert.ElementsMatch(t, []string{"MLU-a", "MLU-b", "MLU-c"}, ids)
+	assert.Equal(t, 2, fake.lists)
+}
+
+func TestPodResourcesWithoutGet(t *testing.T) {
+	fake, socket := startFakePodResources(t, false)
+	fake.setPod("pod1", "cambricon.com/mlu", "MLU-a")
+
+	p := newPodResources(socket, time.Second, maxSize)
+	defer p.close()
+	_, err := p.inUse(nil)
+	assert.NoError(t, err)
+
+	fake.setPod("pod2", "cambricon.com/mlu", "MLU-b")
+	for i := 0; i < 3; i++ {
+		ids, err := p.inUse(map[podKey]bool{{namespace: "default", name: "pod2"}: false})
+		assert.NoError(t, err)
+		assert.ElementsMatch(t, []string{"MLU-a", "MLU-b"}, ids)
+	}
+	assert.Equal(t, 4, fake.lists)
+	assert.True(t, p.getFailed)
+}
@@ -0,0 +1,66 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package topology
+
+import (
+	"sort"
+	"strconv"
+	"strings"
+)
+
+// ringCache is a bounded table of the best NonConflictRingNum per available
+// set and size, evicting the oldest entries first.
+type ringCache struct {
+	size    int
+	entries map[string]int
+	order   []string
+}
+
+func newRingCache(size int) *ringCache {
+	return &ringCache{size: size, entries: map[string]int{}}
+}
+
+func ringKey(available []uint, size int) string {
+	sorted := append([]uint(nil), available...)
+	sort.Slice(sorted, func(i, j int) bool { return sorted[i] < sorted[j] })
+	var b strings.Builder
+	b.WriteString(strconv.Itoa(size))
+	b.WriteByte(':')
+	for i, s := range sorted {
+		if i > 0 {
+			b.WriteByte(',')
+		}
+		b.WriteString(strconv.FormatUint(uint64(s), 10))
+	}
+	return b.String()
+}
+
+func (c *ringCache) get(key string) (int, bool) {
+	best, ok := c.entries[key]
+	return best, ok
+}
+
+func (c *ringCache) add(key string, best int) {
+	if _, ok := c.entries[key]; ok {
+		c.entries[key] = best
+		return
+	}
+	if len(c.order) >= c.size {
+		delete(c.entries, c.order[0])
+		c.order = c.order[1:]
+	}
+	c.entries[key] = best
+	c.order = append(c.order, key)
+}
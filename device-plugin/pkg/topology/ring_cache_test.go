@@ -0,0 +1,40 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package topology
+
+import (
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestRingCache(t *testing.T) {
+	assert.Equal(t, ringKey([]uint{3, 1, 2}, 2), ringKey([]uint{1, 2, 3}, 2))
+	assert.NotEqual(t, ringKey([]uint{1, 2, 3}, 2), ringKey([]uint{1, 2, 3}, 4))
+	assert.NotEqual(t, ringKey([]uint{1, 23}, 2), ringKey([]uint{12, 3}, 2))
+
+	c := newRingCache(2)
+	c.add("a", 1)
+	c.add("b", -1)
+	best, ok := c.get("b")
+	assert.True(t, ok)
+	assert.Equal(t, -1, best)
+	c.add("c", 4)
+	_, ok = c.get("a")
+	assert.False(t, ok)
+	best, ok = c.get("c")
+	assert.True(t, ok)
+	assert.Equal(t, 4, best)
+}
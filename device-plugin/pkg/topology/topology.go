@@ -16,10 +16,8 @@ package topology
 
 import (
 	"context"
-	"fmt"
-	"math/rand"
-	"net"
-	"sort"
+	"encoding/json"
+	"reflect"
 	"strconv"
 	"strings"
 	"sync"
@@ -28,16 +26,15 @@ import (
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/allocator"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cndev"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cntopo"
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/informer"
 	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/mlu"
 	log "github.com/sirupsen/logrus"
-	"google.golang.org/grpc"
-	"google.golang.org/grpc/credentials/insecure"
 	corev1 "k8s.io/api/core/v1"
 	metav1 "k8s.io/apimachinery/pkg/apis/meta/v1"
-	"k8s.io/apimachinery/pkg/fields"
+	"k8s.io/apimachinery/pkg/labels"
+	"k8s.io/apimachinery/pkg/types"
 	"k8s.io/client-go/kubernetes"
 	"k8s.io/client-go/tools/cache"
-	podresourcesapi "k8s.io/kubelet/pkg/apis/podresources/v1alpha1"
 )
 
 var (
@@ -51,15 +48,28 @@ var (
 		"095U": {2: 2, 4: 6},
 	}
 	uuidPrefix = "MLU-"
+
+	debounce      = 500 * time.Millisecond
+	maxRetry      = time.Minute
+	minRetry      = time.Second
+	resync        = 30 * time.Second
+	ringCacheSize = 256
 )
 
 type Topology struct {
-	annotation  map[string]string
-	available   []uint
-	deviceMaps  map[string]uint
-	executeLock sync.Mutex
-	option      mlu.Options
-	topoRule    map[int]int
+	annotation   map[string]string
+	available    []uint
+	changed      map[podKey]bool
+	changedLock  sync.Mutex
+	checkpoint   *checkpoint
+	deviceMaps   map[string]uint
+	executeLock  sync.Mutex
+	option       mlu.Options
+	podResources *podResources
+	rings        *ringCache
+	topoRule     map[int]int
+	trigger      chan struct{}
+	written      map[string]*string
 
 	k8sClient  kubernetes.Interface
 	topoClient cntopo.Cntopo
@@ -81,234 +91,339 @@ func NewTopology(o mlu.Options, num uint) *Topology {
 		}
 		devM[uuid] = i
 	}
-	return &Topology{
-		deviceMaps: devM,
-		option:     o,
-		topoRule:   topoRule,
+	t := &Topology{
+		changed:      map[podKey]bool{},
+		deviceMaps:   devM,
+		option:       o,
+		podResources: newPodResources(socket, timeout, maxSize),
+		rings:        newRingCache(ringCacheSize),
+		topoRule:     topoRule,
+		trigger:      make(chan struct{}, 1),
 
 		k8sClient:  mlu.InitClientSet(),
 		topoClient: cntopo.New(),
 	}
+	if o.KubeletCheckpoint {
+		t.checkpoint = newCheckpoint(kubeletCheckpoint, devM)
+	}
+	return t
 }
 
-func (t *Topology) findCardInUse() (bool, error) {
-	oldAvail := t.available
+// findCardInUse returns the mlus not allocated to any pod and whether they
+// are the same as those of the last successful execute.
+func (t *Topology) findCardInUse() ([]uint, bool, error) {
 	avail := []uint{}
-	deviceIDs, err := getDeviceIDsInUse(socket, timeout, maxSize)
+	inUse, err := t.inUse()
 	if err != nil {
 		log.Errorf("failed to get deviceIDs %v", err)
-		return false, err
-	}
-	info := map[string]struct{}{}
-	for _, id := range deviceIDs {
-		d := strings.TrimLeft(id, uuidPrefix)
-		info[d] = struct{}{}
+		return nil, false, err
 	}
-	for d, i := range t.deviceMaps {
-		if _, ok := info[d]; ok {
+	for _, i := range t.deviceMaps {
+		if inUse.has(i) {
 			continue
 		}
 		avail = append(avail, i)
 	}
-	if equalWithoutOrder(oldAvail, avail) {
-		return true, err
+	return avail, t.available != nil && equalWithoutOrder(t.available, avail), nil
+}
+
+// inUse returns the mlus allocated to active pods, from the kubelet
+// checkpoint if enabled or else from the pod resources API.
+func (t *Topology) inUse() (deviceMask, error) {
+	t.changedLock.Lock()
+	changed := t.changed
+	t.changed = map[podKey]bool{}
+	t.changedLock.Unlock()
+
+	if t.checkpoint != nil {
+		active, err := t.activePods()
+		if err != nil {
+			return 0, err
+		}
+		return t.checkpoint.inUse(func(uid string) bool {
+			_, ok := active[uid]
+			return ok
+		}), nil
+	}
+
+	deviceIDs, err := t.podResources.inUse(changed)
+	if err != nil {
+		return 0, err
+	}
+	var mask deviceMask
+	for _, id := range deviceIDs {
+		if i, ok := t.deviceMaps[strings.TrimLeft(id, uuidPrefix)]; ok && i < maxMaskSlots {
+			mask |= 1 << i
+		}
 	}
-	t.available = avail
-	return false, nil
+	return mask, nil
 }
 
-func (t *Topology) getTopo() error {
+// activePods returns the UIDs of the pods on the node which have not
+// terminated, according to the shared pod informer.
+func (t *Topology) activePods() (map[string]struct{}, error) {
+	pods, err := informer.ForNode(t.k8sClient, t.option.NodeName).PodLister().List(labels.Everything())
+	if err != nil {
+		return nil, err
+	}
+	active := make(map[string]struct{}, len(pods))
+	for _, pod := range pods {
+		if pod.Status.Phase == corev1.PodSucceeded || pod.Status.Phase == corev1.PodFailed {
+			continue
+		}
+		active[string(pod.UID)] = struct{}{}
+	}
+	return active, nil
+}
+
+func (t *Topology) getTopo(avail []uint) (map[string]string, error) {
 	annotation := map[string]string{}
 	for size, ring := range t.topoRule {
-		if len(t.available) < size {
+		if len(avail) < size {
 			continue
 		}
-		rings, err := t.topoClient.GetRings(t.available, size)
+		best, err := t.bestRingNum(avail, size)
 		if err != nil {
 			log.Errorf("failed to get rings %v", err)
-			return err
+			return nil, err
 		}
-		if len(rings) == 0 {
+		if best < 0 {
 			continue
 		}
-		sort.Slice(rings, func(i int, j int) bool {
-			return rings[i].NonConflictRingNum > rings[j].NonConflictRingNum
-		})
-		if rings[0].NonConflictRingNum < ring {
+		if best < ring {
 			annotation[strconv.Itoa(size)+"-cards"] = "guaranteed"
 			continue
 		}
 		annotation[strconv.Itoa(size)+"-cards"] = "restricted"
 	}
-	t.annotation = annotation
-	return nil
+	return annotation, nil
 }
 
-func (t *Topology) UpdateNodeAnnotation() error {
-	node, err := t.k8sClient.CoreV1().Nodes().Get(context.TODO(), t.option.NodeName, metav1.GetOptions{})
+// bestRingNum returns the highest NonConflictRingNum of size cards among the
+// available ones, or the first reaching the rule of size, or -1 if there is
+// no ring. Results are cached by the available set since the topology of a
+// node never changes.
+func (t *Topology) bestRingNum(avail []uint, size int) (int, error) {
+	key := ringKey(avail, size)
+	if best, ok := t.rings.get(key); ok {
+		return best, nil
+	}
+	rings, err := t.topoClient.GetRingsWithOptions(avail, size, cntopo.QueryOptions{
+		BestOnly: true,
+		Target:   t.topoRule[size],
+	})
 	if err != nil {
-		log.Errorf("Failed get node, err: %v", err)
-		return err
+		return 0, err
 	}
-
-	if len(node.Annotations) == 0 && len(t.annotation) == 0 {
-		return nil
+	best := -1
+	for _, r := range rings {
+		if r.NonConflictRingNum > best {
+			best = r.NonConflictRingNum
+		}
 	}
+	t.rings.add(key, best)
+	return best, nil
+}
 
-	var needUpdate bool
+// UpdateNodeAnnotation merge patches the N-cards annotations of the node,
+// deleting those without a value. The last written annotations are kept so
+// that nothing is sent when they did not change, they are forgotten on
+// failure to write them all again on the next call.
+func (t *Topology) UpdateNodeAnnotation() error {
+	annotations := map[string]*string{}
 	for size := range t.topoRule {
 		key := strconv.Itoa(size) + "-cards"
-		if _, ok := node.Annotations[key]; ok {
-			if _, ok := t.annotation[key]; ok {
-				continue
-			}
-			delete(node.Annotations, key)
-			needUpdate = true
-			continue
-		}
 		if v, ok := t.annotation[key]; ok {
-			node.Annotations[key] = v
-			needUpdate = true
+			annotations[key] = &v
+			continue
 		}
+		annotations[key] = nil
 	}
-
-	if !needUpdate {
+	if t.written != nil && reflect.DeepEqual(t.written, annotations) {
+		return nil
+	}
+	if len(annotations) == 0 {
 		return nil
 	}
 
-	log.Printf("Try to update node annotation, available is: %v, topology is: %v", t.available, t.annotation)
-	time.Sleep(time.Duration(rand.Intn(5)) * 5 * time.Millisecond)
-	_, err = t.k8sClient.CoreV1().Nodes().Update(context.TODO(), node, metav1.UpdateOptions{})
-	return err
+	patch, err := json.Marshal(map[string]interface{}{
+		"metadata": map[string]interface{}{"annotations": annotations},
+	})
+	if err != nil {
+		return err
+	}
+	log.Printf("Try to update node annotation, topology is: %v", t.annotation)
+	_, err = t.k8sClient.CoreV1().Nodes().Patch(context.TODO(), t.option.NodeName, types.MergePatchType, patch, metav1.PatchOptions{})
+	if err != nil {
+		t.written = nil
+		return err
+	}
+	t.written = annotations
+	return nil
 }
 
-func (t *Topology) SetTopology() {
-	t.execute()
+// kick schedules an execute for a changed pod, events arriving before the
+// worker picks it up are coalesced into the same run.
+func (t *Topology) kick(pod *corev1.Pod, deleted bool) {
+	// containers of finished pods have released their devices
+	if pod.Status.Phase == corev1.PodSucceeded || pod.Status.Phase == corev1.PodFailed {
+		deleted = true
+	}
+	t.changedLock.Lock()
+	t.changed[podKey{namespace: pod.Namespace, name: pod.Name}] = deleted
+	t.changedLock.Unlock()
+	t.schedule()
+}
 
-	podWatcher := cache.NewFilteredListWatchFromClient(
-		t.k8sClient.CoreV1().RESTClient(),
-		"pods",
-		metav1.NamespaceAll,
-		func(options *metav1.ListOptions) {
-			options.FieldSelector = fields.OneTermEqualSelector("spec.nodeName", t.option.NodeName).String()
-		},
-	)
+func (t *Topology) schedule() {
+	select {
+	case t.trigger <- struct{}{}:
+	default:
+	}
+}
+
+// resync makes the next execute rebuild the allocations from the kubelet
+// instead of relying on the pod events received so far.
+func (t *Topology) resync() {
+	if t.checkpoint == nil {
+		t.podResources.resync()
+		return
+	}
+	if _, err := t.checkpoint.load(); err != nil {
+		log.Warnf("Failed to load kubelet checkpoint: %v", err)
+	}
+}
+
+// worker runs execute once per burst of pod events, waiting debounce after
+// the first event so that a batch of pods being created or deleted only
+// costs a single podresources list. Failed runs are retried with an
+// exponential backoff, and allocations are resynced every resync period in
+// case an event was missed.
+func (t *Topology) worker(stopCh <-chan struct{}) {
+	ticker := time.NewTicker(resync)
+	defer ticker.Stop()
+	var retry <-chan time.Time
+	backoff := minRetry
+	for {
+		select {
+		case <-stopCh:
+			return
+		case <-t.trigger:
+		case <-retry:
+		case <-ticker.C:
+			t.resync()
+		}
+		select {
+		case <-stopCh:
+			return
+		case <-time.After(debounce):
+		}
+		select {
+		case <-t.trigger:
+		default:
+		}
+		if err := t.execute(); err != nil {
+			log.Warnf("Failed to update topology, retry in %v", backoff)
+			retry = time.After(backoff)
+			backoff = min(2*backoff, maxRetry)
+			continue
+		}
+		retry = nil
+		backoff = minRetry
+	}
+}
 
-	resyncPeriod := 30 * time.Second
+func (t *Topology) SetTopology() {
 	stopCh := make(chan struct{})
 	defer close(stopCh)
-	_, controller := cache.NewInformer(
-		podWatcher,
-		&corev1.Pod{},
-		resyncPeriod,
-		cache.ResourceEventHandlerFuncs{
-			AddFunc: func(obj interface{}) {
-				pod := obj.(*corev1.Pod)
-				if matchResource(pod) {
-					log.Debugf("Find pod use mlu %s is being added", pod.Name)
-					t.execute()
-				}
-			},
-			UpdateFunc: func(_, newObj interface{}) {
-				newPod := newObj.(*corev1.Pod)
-				if matchResource(newPod) {
-					log.Debugf("Find pod use mlu %s is being updated", newPod.Name)
-					t.execute()
+	pods := informer.ForNode(t.k8sClient, t.option.NodeName).Pods()
+	if t.checkpoint != nil {
+		// terminated pods are filtered out with the pod cache
+		if !cache.WaitForCacheSync(stopCh, pods.HasSynced) {
+			log.Errorf("Failed to sync pod cache on node %s", t.option.NodeName)
+			return
+		}
+		if _, err := t.checkpoint.load(); err != nil {
+			log.Warnf("Failed to load kubelet checkpoint: %v", err)
+		}
+		if err := t.checkpoint.watch(stopCh, t.schedule); err != nil {
+			log.Errorf("Failed to watch kubelet checkpoint, fall back to pod resources API: %v", err)
+			t.checkpoint = nil
+		}
+	}
+	if err := t.execute(); err != nil {
+		t.schedule()
+	}
+
+	go t.worker(stopCh)
+	_, err := pods.AddEventHandler(cache.ResourceEventHandlerFuncs{
+		AddFunc: func(obj interface{}) {
+			pod := obj.(*corev1.Pod)
+			if matchResource(pod) {
+				log.Debugf("Find pod use mlu %s is being added", pod.Name)
+				t.kick(pod, false)
+			}
+		},
+		UpdateFunc: func(oldObj, newObj interface{}) {
+			oldPod := oldObj.(*corev1.Pod)
+			newPod := newObj.(*corev1.Pod)
+			if allocationChanged(oldPod, newPod) {
+				log.Debugf("Find pod use mlu %s is being updated", newPod.Name)
+				t.kick(newPod, false)
+			}
+		},
+		DeleteFunc: func(obj interface{}) {
+			pod, ok := obj.(*corev1.Pod)
+			if !ok {
+				tombstone, ok := obj.(cache.DeletedFinalStateUnknown)
+				if !ok {
+					return
 				}
-			},
-			DeleteFunc: func(obj interface{}) {
-				pod := obj.(*corev1.Pod)
-				if matchResource(pod) {
-					log.Debugf("Find pod use mlu %s is being deleted", pod.Name)
-					t.execute()
+				if pod, ok = tombstone.Obj.(*corev1.Pod); !ok {
+					return
 				}
-			},
+			}
+			if matchResource(pod) {
+				log.Debugf("Find pod use mlu %s is being deleted", pod.Name)
+				t.kick(pod, true)
+			}
 		},
-	)
-	go controller.Run(stopCh)
+	})
+	if err != nil {
+		log.Errorf("Failed to watch pods on node %s: %v", t.option.NodeName, err)
+		return
+	}
 	<-stopCh
 }
 
-func (t *Topology) execute() {
+// execute annotates the node with the topology of the available mlus. They
+// are only remembered once the node is patched, so a failed run is not
+// mistaken for an unchanged allocation by the next one.
+func (t *Topology) execute() error {
 	t.executeLock.Lock()
 	defer t.executeLock.Unlock()
 
-	t.annotation = map[string]string{}
-	sameWithOld, err := t.findCardInUse()
+	avail, sameWithOld, err := t.findCardInUse()
 	if err != nil {
 		log.Errorf("Failed to find card in use %v", err)
-		return
+		return err
 	}
 	if sameWithOld {
 		log.Debug("No change since last sync")
-		return
+		return nil
 	}
-	if err := t.getTopo(); err != nil {
+	annotation, err := t.getTopo(avail)
+	if err != nil {
 		log.Errorf("Failed to get topo %v", err)
-		return
+		return err
 	}
+	t.annotation = annotation
 	if err := t.UpdateNodeAnnotation(); err != nil {
 		log.Errorf("Failed to update node annotation %v", err)
+		return err
 	}
-}
-
-func connectToServer(socket string, timeout time.Duration, maxSize int) (*grpc.ClientConn, error) {
-	ctx, cancel := context.WithTimeout(context.Background(), timeout)
-	defer cancel()
-
-	creds := insecure.NewCredentials()
-	dialer := func(_ context.Context, address string) (net.Conn, error) {
-		return net.DialTimeout("unix", address, timeout)
-	}
-	conn, err := grpc.DialContext(ctx, socket,
-		grpc.WithTransportCredentials(creds),
-		grpc.WithBlock(),
-		grpc.WithDefaultCallOptions(grpc.MaxCallRecvMsgSize(maxSize)),
-		grpc.WithContextDialer(dialer),
-	)
-	if err != nil {
-		return nil, fmt.Errorf("failure connecting to %s: %v", socket, err)
-	}
-	return conn, nil
-}
-
-func listPods(socket string, timeout time.Duration, maxSize int) (*podresourcesapi.ListPodResourcesResponse, error) {
-	conn, err := connectToServer(socket, timeout, maxSize)
-	if err != nil {
-		return nil, err
-	}
-	defer conn.Close()
-
-	client := podresourcesapi.NewPodResourcesListerClient(conn)
-
-	ctx, cancel := context.WithTimeout(context.Background(), timeout)
-	defer cancel()
-
-	resp, err := client.List(ctx, &podresourcesapi.ListPodResourcesRequest{})
-	if err != nil {
-		return nil, fmt.Errorf("failure getting pod resources %v", err)
-	}
-	return resp, nil
-}
-
-func getDeviceIDsInUse(socket string, timeout time.Duration, maxSize int) ([]string, error) {
-	var deviceIDs []string
-	pods, err := listPods(socket, timeout, maxSize)
-	if err != nil {
-		return nil, fmt.Errorf("list pods: %v", err)
-	}
-	for _, pod := range pods.GetPodResources() {
-		for _, container := range pod.GetContainers() {
-			for _, device := range container.GetDevices() {
-				if !strings.Contains(device.GetResourceName(), "cambricon.com/mlu") {
-					continue
-				}
-				deviceIDs = append(deviceIDs, device.GetDeviceIds()...)
-			}
-		}
-	}
-	log.Debugf("deviceIDs: %#v", deviceIDs)
-	return deviceIDs, nil
+	t.available = avail
+	return nil
 }
 
 func matchResource(pod *corev1.Pod) bool {
@@ -326,6 +441,21 @@ func matchResource(pod *corev1.Pod) bool {
 	return false
 }
 
+// allocationChanged reports whether an update may change the mlus allocated
+// on the node. Status only updates and informer resyncs of running pods are
+// ignored, the worker resyncs with the kubelet on its own.
+func allocationChanged(oldPod, newPod *corev1.Pod) bool {
+	if oldPod.ResourceVersion == newPod.ResourceVersion {
+		return false
+	}
+	if !matchResource(oldPod) && !matchResource(newPod) {
+		return false
+	}
+	return oldPod.Status.Phase != newPod.Status.Phase ||
+		(oldPod.DeletionTimestamp == nil) != (newPod.DeletionTimestamp == nil) ||
+		matchResource(oldPod) != matchResource(newPod)
+}
+
 func equalWithoutOrder(a, b []uint) bool {
 	if len(a) != len(b) {
 		return false
@@ -0,0 +1,156 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package topology
+
+import (
+	"context"
+	"errors"
+	"testing"
+	"time"
+
+	"github.com/Cambricon/cambricon-k8s-device-plugin/device-plugin/pkg/cntopo"
+	"github.com/stretchr/testify/assert"
+	corev1 "k8s.io/api/core/v1"
+	"k8s.io/apimachinery/pkg/api/resource"
+	metav1 "k8s.io/apimachinery/pkg/apis/meta/v1"
+	"k8s.io/apimachinery/pkg/runtime"
+	"k8s.io/client-go/kubernetes/fake"
+	k8stesting "k8s.io/client-go/testing"
+)
+
+func mluPod(rv string, phase corev1.PodPhase) *corev1.Pod {
+	return &corev1.Pod{
+		ObjectMeta: metav1.ObjectMeta{Name: "pod", ResourceVersion: rv},
+		Spec: corev1.PodSpec{
+			Containers: []corev1.Container{{
+				Resources: corev1.ResourceRequirements{
+					Limits: corev1.ResourceList{"cambricon.com/mlu": resource.MustParse("1")},
+				},
+			}},
+		},
+		Status: corev1.PodStatus{Phase: phase},
+	}
+}
+
+func TestAllocationChanged(t *testing.T) {
+	running := mluPod("1", corev1.PodRunning)
+	assert.False(t, allocationChanged(running, running), "resync")
+	assert.False(t, allocationChanged(running, mluPod("2", corev1.PodRunning)), "status update")
+	assert.True(t, allocationChanged(mluPod("1", corev1.PodPending), mluPod("2", corev1.PodRunning)))
+	assert.True(t, allocationChanged(running, mluPod("2", corev1.PodSucceeded)))
+
+	deleting := mluPod("2", corev1.PodRunning)
+	deleting.DeletionTimestamp = &metav1.Time{}
+	assert.True(t, allocationChanged(running, deleting))
+
+	other := mluPod("1", corev1.PodPending)
+	other.Spec.Containers[0].Resources.Limits = corev1.ResourceList{}
+	assert.False(t, allocationChanged(other, &corev1.Pod{
+		ObjectMeta: metav1.ObjectMeta{ResourceVersion: "2"},
+		Status:     corev1.PodStatus{Phase: corev1.PodRunning},
+	}))
+}
+
+func TestUpdateNodeAnnotation(t *testing.T) {
+	client := fake.NewSimpleClientset(&corev1.Node{
+		ObjectMeta: metav1.ObjectMeta{
+			Name:        "node",
+			Annotations: map[string]string{"4-cards": "restricted", "other": "kept"},
+		},
+	})
+	topo := &Topology{k8sClient: client, topoRule: map[int]int{2: 2, 4: 4}}
+	topo.option.NodeName = "node"
+	annotations := func() map[string]string {
+		node, err := client.CoreV1().Nodes().Get(context.TODO(), "node", metav1.GetOptions{})
+		assert.NoError(t, err)
+		return node.Annotations
+	}
+
+	topo.annotation = map[string]string{"2-cards": "guaranteed"}
+	assert.NoError(t, topo.UpdateNodeAnnotation())
+	assert.Equal(t, map[string]string{"2-cards": "guaranteed", "other": "kept"}, annotations())
+	for _, action := range client.Actions() {
+		assert.Equal(t, "patch", action.GetVerb())
+	}
+
+	// unchanged annotations are not written again
+	client.ClearActions()
+	assert.NoError(t, topo.UpdateNodeAnnotation())
+	assert.Empty(t, client.Actions())
+
+	// a failed write is retried by the next call
+	client.PrependReactor("patch", "nodes", func(k8stesting.Action) (bool, runtime.Object, error) {
+		return true, nil, errors.New("conflict")
+	})
+	topo.annotation = map[string]string{"4-cards": "guaranteed"}
+	assert.Error(t, topo.UpdateNodeAnnotation())
+	client.ReactionChain = client.ReactionChain[1:]
+	assert.NoError(t, topo.UpdateNodeAnnotation())
+	assert.Equal(t, map[string]string{"4-cards": "guaranteed", "other": "kept"}, annotations())
+}
+
+type fakeCntopo struct{ best int }
+
+func (f fakeCntopo) GetRings(available []uint, size int) ([]cntopo.Ring, error) {
+	return f.GetRingsWithOptions(available, size, cntopo.QueryOptions{})
+}
+
+func (f fakeCntopo) GetRingsWithOptions(available []uint, size int, _ cntopo.QueryOptions) ([]cntopo.Ring, error) {
+	return []cntopo.Ring{{Ordinals: available[:size], NonConflictRingNum: f.best}}, nil
+}
+
+func TestExecute(t *testing.T) {
+	kubelet, socket := startFakePodResources(t, false)
+	kubelet.setPod("pod1", "cambricon.com/mlu", "MLU-a")
+	client := fake.NewSimpleClientset(&corev1.Node{ObjectMeta: metav1.ObjectMeta{Name: "node"}})
+	topo := &Topology{
+		changed:      map[podKey]bool{},
+		deviceMaps:   map[string]uint{"a": 0, "b": 1, "c": 2},
+		podResources: newPodResources(socket, time.Second, maxSize),
+		rings:        newRingCache(ringCacheSize),
+		topoRule:     map[int]int{2: 2},
+
+		k8sClient:  client,
+		topoClient: fakeCntopo{best: 2},
+	}
+	topo.option.NodeName = "node"
+	defer topo.podResources.close()
+	annotations := func() map[string]string {
+		node, err := client.CoreV1().Nodes().Get(context.TODO(), "node", metav1.GetOptions{})
+		assert.NoError(t, err)
+		return node.Annotations
+	}
+
+	// the allocation is not remembered until the node is patched
+	client.PrependReactor("patch", "nodes", func(k8stesting.Action) (bool, runtime.Object, error) {
+		return true, nil, errors.New("conflict")
+	})
+	assert.Error(t, topo.execute())
+	assert.Nil(t, topo.available)
+	client.ReactionChain = client.ReactionChain[1:]
+	assert.NoError(t, topo.execute())
+	assert.ElementsMatch(t, []uint{1, 2}, topo.available)
+	assert.Equal(t, map[string]string{"2-cards": "restricted"}, annotations())
+
+	// a pod created without any event is only seen after a resync
+	kubelet.setPod("pod2", "cambricon.com/mlu", "MLU-b")
+	assert.NoError(t, topo.execute())
+	assert.ElementsMatch(t, []uint{1, 2}, topo.available)
+	topo.resync()
+	assert.NoError(t, topo.execute())
+	assert.Equal(t, []uint{2}, topo.available)
+	assert.Empty(t, annotations())
+	assert.Equal(t, 2, kubelet.lists)
+}
@@ -0,0 +1,236 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Package uevent listens to kernel kobject uevents of MLU devices.
+package uevent
+
+import (
+	"bytes"
+	"context"
+	"errors"
+	"fmt"
+	"sort"
+	"strings"
+	"syscall"
+	"time"
+
+	log "github.com/sirupsen/logrus"
+)
+
+const (
+	// kernel uevents are multicast to group 1, udev rebroadcasts to group 2
+	kernelGroup = 1
+	recvTimeout = time.Second
+	bufferSize  = 64 * 1024
+
+	mluPCIVendor     = "CABC"
+	mluDevNamePrefix = "cambricon"
+)
+
+// Actions of kernel uevents which change the set of usable devices.
+const (
+	Add    = "add"
+	Remove = "remove"
+	Bind   = "bind"
+	Unbind = "unbind"
+	Change = "change"
+	// Overrun is reported by the Listener when the socket dropped events.
+	Overrun = "overrun"
+)
+
+// Event is a parsed kernel uevent.
+type Event struct {
+	Action    string
+	DevPath   string
+	Subsystem string
+	Env       map[string]string
+}
+
+// IsMLU reports whether the event is about a Cambricon PCI function or one
+// of the cambricon character devices.
+func (e Event) IsMLU() bool {
+	if e.Subsystem == "pci" && strings.HasPrefix(strings.ToUpper(e.Env["PCI_ID"]), mluPCIVendor+":") {
+		return true
+	}
+	return strings.HasPrefix(e.Env["DEVNAME"], mluDevNamePrefix)
+}
+
+// ChangesDevices reports whether the event adds, removes or rebinds a device,
+// which requires devices to be discovered again.
+func (e Event) ChangesDevices() bool {
+	switch e.Action {
+	case Add, Remove, Bind, Unbind, Overrun:
+		return true
+	}
+	return false
+}
+
+// Parse decodes a kernel uevent, "action@devpath" followed by KEY=VALUE
+// pairs, all NUL terminated.
+func Parse(msg []byte) (Event, error) {
+	fields := bytes.Split(bytes.TrimRight(msg, "\x00"), []byte{0})
+	header := string(fields[0])
+	if header == "libudev" {
+		return Event{}, errors.New("udev message is not a kernel uevent")
+	}
+	action, devpath, ok := strings.Cut(header, "@")
+	if !ok {
+		return Event{}, fmt.Errorf("invalid uevent header %q", header)
+	}
+	e := Event{Action: action, DevPath: devpath, Env: map[string]string{}}
+	for _, field := range fields[1:] {
+		k, v, ok := strings.Cut(string(field), "=")
+		if !ok {
+			continue
+		}
+		e.Env[k] = v
+	}
+	if a, ok := e.Env["ACTION"]; ok {
+		e.Action = a
+	}
+	e.Subsystem = e.Env["SUBSYSTEM"]
+	return e, nil
+}
+
+func (e Event) marshal() []byte {
+	var b bytes.Buffer
+	fmt.Fprintf(&b, "%s@%s\x00", e.Action, e.DevPath)
+	env := map[string]string{"ACTION": e.Action, "DEVPATH": e.DevPath}
+	if e.Subsystem != "" {
+		env["SUBSYSTEM"] = e.Subsystem
+	}
+	for k, v := range e.Env {
+		env[k] = v
+	}
+	keys := make([]string, 0, len(env))
+	for k := range env {
+		keys = append(keys, k)
+	}
+	sort.Strings(keys)
+	for _, k := range keys {
+		fmt.Fprintf(&b, "%s=%s\x00", k, env[k])
+	}
+	return b.Bytes()
+}
+
+// Listener receives uevents from a datagram socket.
+type Listener struct {
+	fd int
+}
+
+// Listen opens a netlink socket bound to the kernel uevent group. Uevents
+// are only sent to the initial network namespace, so the plugin must run
+// with host network.
+func Listen() (*Listener, error) {
+	fd, err := syscall.Socket(syscall.AF_NETLINK, syscall.SOCK_DGRAM|syscall.SOCK_CLOEXEC, syscall.NETLINK_KOBJECT_UEVENT)
+	if err != nil {
+		return nil, fmt.Errorf("create netlink socket: %v", err)
+	}
+	addr := &syscall.SockaddrNetlink{Family: syscall.AF_NETLINK, Groups: kernelGroup}
+	if err := syscall.Bind(fd, addr); err != nil {
+		syscall.Close(fd)
+		return nil, fmt.Errorf("bind netlink socket: %v", err)
+	}
+	return newListener(fd)
+}
+
+func newListener(fd int) (*Listener, error) {
+	// Close does not interrupt a blocking recv, poll ctx instead.
+	tv := syscall.NsecToTimeval(recvTimeout.Nanoseconds())
+	if err := syscall.SetsockoptTimeval(fd, syscall.SOL_SOCKET, syscall.SO_RCVTIMEO, &tv); err != nil {
+		syscall.Close(fd)
+		return nil, fmt.Errorf("set receive timeout: %v", err)
+	}
+	return &Listener{fd: fd}, nil
+}
+
+// Run sends MLU uevents to events until ctx is done, then closes the listener.
+func (l *Listener) Run(ctx context.Context, events chan<- Event) error {
+	defer syscall.Close(l.fd)
+	buf := make([]byte, bufferSize)
+	for {
+		if ctx.Err() != nil {
+			return nil
+		}
+		n, _, err := syscall.Recvfrom(l.fd, buf, 0)
+		if err != nil {
+			if errors.Is(err, syscall.EAGAIN) || errors.Is(err, syscall.EINTR) {
+				continue
+			}
+			if errors.Is(err, syscall.ENOBUFS) {
+				// events were dropped, let the receiver discover devices again
+				log.Warnf("Uevent socket overrun, some events are lost")
+				e := Event{Action: Overrun, Env: map[string]string{}}
+				select {
+				case events <- e:
+				case <-ctx.Done():
+					return nil
+				}
+				continue
+			}
+			return fmt.Errorf("receive uevent: %v", err)
+		}
+		e, err := Parse(buf[:n])
+		if err != nil {
+			log.Debugf("Ignore uevent: %v", err)
+			continue
+		}
+		if !e.IsMLU() {
+			continue
+		}
+		log.Debugf("Received uevent %s %s", e.Action, e.DevPath)
+		select {
+		case events <- e:
+		case <-ctx.Done():
+			return nil
+		}
+	}
+}
+
+// Injector writes uevents to a Listener through a local socket pair, so the
+// uevent handling can be exercised without root or netlink.
+type Injector struct {
+	fd int
+}
+
+// NewInjector returns a Listener and the Injector feeding it.
+func NewInjector() (*Listener, *Injector, error) {
+	fds, err := syscall.Socketpair(syscall.AF_UNIX, syscall.SOCK_DGRAM|syscall.SOCK_CLOEXEC, 0)
+	if err != nil {
+		return nil, nil, err
+	}
+	l, err := newListener(fds[0])
+	if err != nil {
+		syscall.Close(fds[1])
+		return nil, nil, err
+	}
+	return l, &Injector{fd: fds[1]}, nil
+}
+
+// Inject sends e in the kernel uevent format.
+func (i *Injector) Inject(e Event) error {
+	_, err := syscall.Write(i.fd, e.marshal())
+	return err
+}
+
+// InjectRaw sends msg as is.
+func (i *Injector) InjectRaw(msg []byte) error {
+	_, err := syscall.Write(i.fd, msg)
+	return err
+}
+
+// Close closes the injector side of the socket pair.
+func (i *Injector) Close() error {
+	return syscall.Close(i.fd)
+}
@@ -0,0 +1,82 @@
+// Copyright 2024 Cambricon, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package uevent
+
+import (
+	"context"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestParse(t *testing.T) {
+	msg := "remove@/devices/pci0000:00/0000:00:01.0/0000:01:00.0\x00ACTION=remove\x00" +
+		"DEVPATH=/devices/pci0000:00/0000:00:01.0/0000:01:00.0\x00SUBSYSTEM=pci\x00" +
+		"PCI_ID=cabc:0590\x00PCI_SLOT_NAME=0000:01:00.0\x00SEQNUM=4242\x00"
+	e, err := Parse([]byte(msg))
+	assert.NoError(t, err)
+	assert.Equal(t, Remove, e.Action)
+	assert.Equal(t, "pci", e.Subsystem)
+	assert.Equal(t, "0000:01:00.0", e.Env["PCI_SLOT_NAME"])
+	assert.True(t, e.IsMLU())
+	assert.True(t, e.ChangesDevices())
+
+	_, err = Parse([]byte("libudev\x00\xfe\xed"))
+	assert.Error(t, err)
+	_, err = Parse([]byte("garbage"))
+	assert.Error(t, err)
+
+	dev := Event{Action: Change, Subsystem: "cambricon_dev", Env: map[string]string{"DEVNAME": "cambricon_dev0"}}
+	assert.True(t, dev.IsMLU())
+	assert.False(t, dev.ChangesDevices())
+	other := Event{Action: Add, Subsystem: "pci", Env: map[string]string{"PCI_ID": "8086:1572"}}
+	assert.False(t, other.IsMLU())
+}
+
+func TestListenerWithInjector(t *testing.T) {
+	l, inj, err := NewInjector()
+	assert.NoError(t, err)
+	defer inj.Close()
+
+	ctx, cancel := context.WithCancel(context.Background())
+	events := make(chan Event, 4)
+	done := make(chan error)
+	go func() { done <- l.Run(ctx, events) }()
+
+	assert.NoError(t, inj.Inject(Event{Action: Add, DevPath: "/devices/pci0000:00/0000:02:00.0", Subsystem: "pci",
+		Env: map[string]string{"PCI_ID": "8086:1572"}}))
+	assert.NoError(t, inj.InjectRaw([]byte("libudev\x00")))
+	assert.NoError(t, inj.Inject(Event{Action: Bind, DevPath: "/devices/pci0000:00/0000:01:00.0", Subsystem: "pci",
+		Env: map[string]string{"PCI_ID": "CABC:0590", "DRIVER": "cambricon"}}))
+
+	select {
+	case e := <-events:
+		assert.Equal(t, Bind, e.Action)
+		assert.Equal(t, "/devices/pci0000:00/0000:01:00.0", e.DevPath)
+		assert.Equal(t, "cambricon", e.Env["DRIVER"])
+	case <-time.After(5 * time.Second):
+		t.Fatal("timeout waiting for uevent")
+	}
+
+	cancel()
+	select {
+	case err := <-done:
+		assert.NoError(t, err)
+	case <-time.After(5 * time.Second):
+		t.Fatal("listener did not stop")
+	}
+	assert.Empty(t, events)
+}